@@ -38,14 +38,19 @@
  */
 
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <functional>
 #include <limits>
 #include <set>
 
+#include <seqan/align.h>
 #include <seqan/rna_io.h>
 #include <seqan/score.h>
 
+#include "node_allocator.hpp"
+
 #define _LOG(vlevel, lstr)   { if (lara::verbose_level >= (vlevel)) std::cerr << lstr; }
 
 namespace lara
@@ -62,21 +67,38 @@ enum ScoringMode
     SCALE
 };
 
+enum StepSizeStrategy
+{
+    HALVING,
+    POLYAK,
+    DEFLECTED,
+    BUNDLE
+};
+
 //! \brief Pair of positions (usually in first and second sequence)
 typedef int32_t                                                  ScoreType;
 typedef uint32_t                                                 UnsignedType;
 typedef seqan::Score<ScoreType, seqan::ScoreMatrix<seqan::Rna5>> SeqScoreMatrix;
 typedef std::pair<size_t, size_t>                                PosPair;
 typedef std::pair<ScoreType, size_t>                             Contact;
-typedef std::set<Contact>                                        PriorityQueue;
-typedef seqan::Gaps<seqan::String<unsigned>, seqan::ArrayGaps>   GappedSeq;
-typedef std::pair<GappedSeq, GappedSeq>                          Alignment;
+typedef std::set<Contact, std::less<Contact>, NodeAllocator<Contact>> PriorityQueue;
+typedef seqan::String<unsigned>                                  PositionSeq;
+typedef seqan::TraceSegment_<typename seqan::Position<PositionSeq>::Type,
+                             typename seqan::Size<PositionSeq>::Type> TraceSegment;
+typedef seqan::String<TraceSegment>                              TraceSegments;
 typedef std::pair<PosPair, std::vector<std::tuple<size_t, size_t, unsigned>>> WeightedAlignedColumns;
 typedef std::chrono::steady_clock                                Clock;
 
 ScoreType const infinity = std::numeric_limits<ScoreType>::max() / 3 * 2;
 float const factor2int = 8192.f;
 
+//! \brief Check whether the gap between the bounds is at most the given fraction of the upper bound.
+inline bool relativeGapClosed(ScoreType lower, ScoreType upper, float relativeGap)
+{
+    return relativeGap > 0.0f &&
+           static_cast<float>(static_cast<int64_t>(upper) - lower) <= relativeGap * std::abs(static_cast<float>(upper));
+}
+
 // Time helper functions.
 template <typename duration_unit = std::chrono::milliseconds>
 inline typename duration_unit::rep timeDiff(Clock::time_point start)
@@ -0,0 +1,190 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+
+#pragma once
+
+/*!\file dual_store.hpp
+ * \brief This file contains a memory of dual values for warm-starting the subgradient optimisation.
+ */
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <seqan/sequence.h>
+
+#include "data_types.hpp"
+
+namespace lara
+{
+
+/*!
+ * \brief A dual variable, described by the base pairs that it connects in the two sequences.
+ */
+struct DualRecord
+{
+    PosPair pairA; // (position of the alignment edge, position of the partner edge) in the first sequence
+    PosPair pairB; // (position of the alignment edge, position of the partner edge) in the second sequence
+    uint64_t context; // relative positions and structure context of both base pairs, see DualStore::context
+    float value;
+    bool known;
+};
+
+/*!
+ * \brief Remembers the dual values of converged alignments for each sequence and base pair.
+ * \details
+ * The pairs of one input family share most of their structure, so the dual values of a base pair tend to be
+ * similar in all alignments that contain the sequence. The store keeps the mean value per sequence and
+ * oriented base pair, which is the most precise key for a sequence that has been aligned before. In addition,
+ * it keeps the mean value per interaction context, i.e. the relative position and the structure context of the
+ * base pairs in both sequences. The context is used for the base pairs without exact entry, e.g. of sequences
+ * that are aligned for the first time. The store is shared by all threads.
+ */
+class DualStore
+{
+private:
+    struct Entry
+    {
+        float sum;
+        unsigned count;
+    };
+
+    // number of bins for the relative position of a base pair in its sequence
+    enum : uint64_t { relativeBins = 64u };
+
+    std::vector<std::unordered_map<uint64_t, Entry>> memory;
+    std::unordered_map<uint64_t, Entry> contextMemory;
+    std::mutex mutex;
+
+    // The context of a base pair: relative position of the alignment edge, orientation and logarithmic span of the
+    // base pair, and the two paired nucleotides.
+    static uint64_t context(seqan::Rna5String const & sequence, PosPair basePair)
+    {
+        uint64_t const relative = basePair.first * relativeBins / seqan::length(sequence);
+        uint64_t const orientation = basePair.first < basePair.second ? 1u : 0u;
+        size_t dist = orientation ? basePair.second - basePair.first : basePair.first - basePair.second;
+        uint64_t span = 0u;
+        for (; dist > 1ul; dist >>= 1)
+            ++span;
+        uint64_t const bases = seqan::ordValue(sequence[basePair.first]) * 5u
+                               + seqan::ordValue(sequence[basePair.second]);
+        return (((relative << 1 | orientation) << 6 | span) << 5) | bases;
+    }
+
+    static uint64_t key(PosPair basePair)
+    {
+        return (static_cast<uint64_t>(basePair.first) << 32) | static_cast<uint64_t>(basePair.second);
+    }
+
+    static bool mean(std::unordered_map<uint64_t, Entry> const & entries, uint64_t entryKey, float & value)
+    {
+        auto it = entries.find(entryKey);
+        if (it == entries.end())
+            return false;
+        value = it->second.sum / it->second.count;
+        return true;
+    }
+
+public:
+    explicit DualStore(size_t numSequences) : memory(numSequences) {}
+
+    DualStore()                              = delete;
+    DualStore(DualStore const &)             = delete;
+    DualStore(DualStore &&)                  = delete;
+    DualStore & operator=(DualStore const &) = delete;
+    DualStore & operator=(DualStore &&)      = delete;
+
+    /*!
+     * \brief The context key of an interaction.
+     * \param sequenceA The first sequence.
+     * \param sequenceB The second sequence.
+     * \param pairA The base pair of the interaction in the first sequence (alignment edge, partner edge).
+     * \param pairB The base pair of the interaction in the second sequence (alignment edge, partner edge).
+     */
+    static uint64_t context(seqan::Rna5String const & sequenceA, seqan::Rna5String const & sequenceB,
+                            PosPair pairA, PosPair pairB)
+    {
+        return context(sequenceA, pairA) << 32 | context(sequenceB, pairB);
+    }
+
+    /*!
+     * \brief Add the dual values of a converged alignment.
+     * \param sequenceIndices The indices of the two aligned sequences.
+     * \param records The dual variables with their final values.
+     */
+    void record(PosPair sequenceIndices, std::vector<DualRecord> const & records)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (DualRecord const & rec : records)
+        {
+            Entry & entryA = memory[sequenceIndices.first][key(rec.pairA)];
+            entryA.sum += rec.value;
+            ++entryA.count;
+            Entry & entryB = memory[sequenceIndices.second][key(rec.pairB)];
+            entryB.sum += rec.value;
+            ++entryB.count;
+            Entry & entryContext = contextMemory[rec.context];
+            entryContext.sum += rec.value;
+            ++entryContext.count;
+        }
+    }
+
+    /*!
+     * \brief Estimate the dual values for a new alignment.
+     * \param sequenceIndices The indices of the two sequences to be aligned.
+     * \param records The dual variables. The value is the average of the means stored for the two sequences,
+     *                if at least one of them is known, and the mean of the context otherwise.
+     */
+    void estimate(PosPair sequenceIndices, std::vector<DualRecord> & records)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (DualRecord & rec : records)
+        {
+            float valueA{};
+            float valueB{};
+            bool const knownA = mean(memory[sequenceIndices.first], key(rec.pairA), valueA);
+            bool const knownB = mean(memory[sequenceIndices.second], key(rec.pairB), valueB);
+            rec.known = knownA || knownB;
+            if (knownA && knownB)
+                rec.value = (valueA + valueB) / 2.0f;
+            else if (rec.known)
+                rec.value = knownA ? valueA : valueB;
+            else
+                rec.known = mean(contextMemory, rec.context, rec.value);
+        }
+    }
+};
+
+} // namespace lara
@@ -38,12 +38,14 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 
 #include <seqan/modifier.h>
 #include <seqan/sequence.h>
 
 #include "data_types.hpp"
+#include "parameters.hpp"
 #include "score.hpp"
 
 namespace lara
@@ -54,6 +56,8 @@ class PairwiseGotoh
 private:
     size_t const lenA;
     size_t const lenB;
+    ScoreType const gapOpen;
+    ScoreType const gapExtend;
 
     std::vector<ScoreType> matrixM;
     std::vector<ScoreType> matrixH;
@@ -65,16 +69,94 @@ private:
         return matrix[(lenB + 1ul) * posA + posB];
     }
 
+    /*!
+     * \brief Compute the row a + 1 of the DP matrix from row a and the match scores of position a.
+     * \param a The position in the first sequence.
+     * \param matchScore Callable that returns the score for aligning the given positions.
+     * \param bBegin The first position in the second sequence, whose cell is computed.
+     * \param bEnd The position in the second sequence after the last computed cell.
+     * \return Whether any entry of the row has changed.
+     */
+    template <typename TMatchScore>
+    bool computeRow(size_t a, TMatchScore && matchScore, size_t bBegin, size_t bEnd)
+    {
+        auto bounded = [] (int64_t value) { return static_cast<ScoreType>(std::max<int64_t>(value, -infinity)); };
+        ScoreType const go = gapOpen;
+        ScoreType const ge = gapExtend;
+        bool changed = false;
+        auto assign = [&changed] (ScoreType & entry, ScoreType value)
+        {
+            changed = changed || entry != value;
+            entry = value;
+        };
+
+        for (size_t b = bBegin; b < bEnd; ++b)
+        {
+            assign(get(matrixM, a + 1, b + 1), bounded(static_cast<int64_t>(std::max({get(matrixM, a, b),
+                                                                                      get(matrixH, a, b),
+                                                                                      get(matrixV, a, b)}))
+                                                       + matchScore(a, b)));
+
+            assign(get(matrixH, a + 1, b + 1), bounded(std::max({get(matrixM, a + 1, b) + go,
+                                                                 get(matrixH, a + 1, b) + ge,
+                                                                 get(matrixV, a + 1, b) + go})));
+
+            assign(get(matrixV, a + 1, b + 1), bounded(std::max({get(matrixM, a, b + 1) + go,
+                                                                 get(matrixH, a, b + 1) + go,
+                                                                 get(matrixV, a, b + 1) + ge})));
+        }
+        return changed;
+    }
+
+    //!\brief Exclude the specified cell from all alignments.
+    void clearCell(size_t posA, size_t posB)
+    {
+        get(matrixM, posA, posB) = -infinity;
+        get(matrixH, posA, posB) = -infinity;
+        get(matrixV, posA, posB) = -infinity;
+    }
+
 public:
     explicit
     PairwiseGotoh(seqan::Rna5String const & seqA, seqan::Rna5String const & seqB, SeqScoreMatrix const & score):
-        lenA(seqan::length(seqA)), lenB(seqan::length(seqB))
+        PairwiseGotoh(seqan::length(seqA), seqan::length(seqB),
+                      [&seqA, &seqB, &score] (size_t posA, size_t posB)
+                      {
+                          return static_cast<ScoreType>(seqan::score(score, seqA[posA], seqB[posB]));
+                      },
+                      score.data_gap_open, score.data_gap_extend)
+    {}
+
+    /*!
+     * \brief Compute the prefix scores for an arbitrary match score function.
+     * \param lengthA The length of the first sequence.
+     * \param lengthB The length of the second sequence.
+     * \param matchScore Callable that returns the score for aligning the given positions.
+     * \param go The gap open score.
+     * \param ge The gap extend score.
+     * \details The entries are bounded below by -infinity, so that forbidden matches cannot cause an overflow.
+     */
+    template <typename TMatchScore>
+    PairwiseGotoh(size_t lengthA, size_t lengthB, TMatchScore && matchScore, ScoreType go, ScoreType ge):
+        PairwiseGotoh(lengthA, lengthB, go, ge)
+    {
+        compute(matchScore);
+    }
+
+    /*!
+     * \brief Initialise the borders of the DP matrix without computing its rows.
+     * \param lengthA The length of the first sequence.
+     * \param lengthB The length of the second sequence.
+     * \param go The gap open score.
+     * \param ge The gap extend score.
+     * \details The rows are computed by a call of compute().
+     */
+    PairwiseGotoh(size_t lengthA, size_t lengthB, ScoreType go, ScoreType ge):
+        lenA(lengthA), lenB(lengthB), gapOpen(go), gapExtend(ge)
     {
         matrixM.resize((lenA + 1) * (lenB + 1));
         matrixH.resize((lenA + 1) * (lenB + 1));
         matrixV.resize((lenA + 1) * (lenB + 1));
-        ScoreType const go = score.data_gap_open;
-        ScoreType const ge = score.data_gap_extend;
 
         // initialise DP matrix
         get(matrixM, 0, 0) = 0;
@@ -95,25 +177,72 @@ public:
             get(matrixH, 0, b + 1) = go + ge * b;
             get(matrixV, 0, b + 1) = -infinity;
         }
+    }
+
+    /*!
+     * \brief Recompute all rows of the DP matrix for new match scores.
+     * \param matchScore Callable that returns the new score for aligning the given positions.
+     * \details The borders depend only on the gap scores and the matrices keep their memory.
+     */
+    template <typename TMatchScore>
+    void compute(TMatchScore && matchScore)
+    {
+        for (size_t a = 0ul; a < lenA; ++a)
+            computeRow(a, matchScore, 0ul, lenB);
+    }
 
-        // fill DP matrix
+    /*!
+     * \brief Recompute the DP matrix for new match scores within a band of diagonals.
+     * \param matchScore Callable that returns the new score for aligning the given positions.
+     * \param lowerDiag The lower diagonal of the band, where the diagonal of a cell is posA - posB.
+     * \param upperDiag The upper diagonal of the band, which must contain both corners of the matrix with lowerDiag.
+     * \details
+     * The cells next to the band are excluded, such that no alignment leaves the band apart from leading gaps along
+     * the borders. The score is a lower bound of the full DP and equal to it, if an optimal alignment lies inside.
+     */
+    template <typename TMatchScore>
+    void compute(TMatchScore && matchScore, int lowerDiag, int upperDiag)
+    {
+        SEQAN_ASSERT_LEQ(lowerDiag, std::min(0, static_cast<int>(lenA) - static_cast<int>(lenB)));
+        SEQAN_ASSERT_GEQ(upperDiag, std::max(0, static_cast<int>(lenA) - static_cast<int>(lenB)));
         for (size_t a = 0ul; a < lenA; ++a)
         {
-            for (size_t b = 0ul; b < lenB; ++b)
-            {
-                get(matrixM, a + 1, b + 1) = std::max({get(matrixM, a, b),
-                                                       get(matrixH, a, b),
-                                                       get(matrixV, a, b)}) + seqan::score(score, seqA[a], seqB[b]);
+            // the cells (a + 1, b + 1) with lowerDiag <= a - b <= upperDiag
+            int64_t const first = static_cast<int64_t>(a) - upperDiag;
+            int64_t const last = static_cast<int64_t>(a) - lowerDiag + 1;
+            size_t const bBegin = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(first, 0), lenB));
+            size_t const bEnd = static_cast<size_t>(std::max<int64_t>(std::min<int64_t>(last, lenB), bBegin));
+            if (bBegin > 0ul)
+                clearCell(a + 1, bBegin);
+            computeRow(a, matchScore, bBegin, bEnd);
+            if (bEnd < lenB)
+                clearCell(a + 1, bEnd + 1);
+        }
+    }
 
-                get(matrixH, a + 1, b + 1) = std::max({get(matrixM, a + 1, b) + go,
-                                                       get(matrixH, a + 1, b) + ge,
-                                                       get(matrixV, a + 1, b) + go});
+    /*!
+     * \brief Recompute the DP matrix after the match scores of some rows have changed.
+     * \param matchScore Callable that returns the new score for aligning the given positions.
+     * \param changedRows Flags for the positions of the first sequence whose match scores have changed.
+     * \return The number of recomputed rows.
+     * \details
+     * The computation starts at the first changed row. A row depends only on the previous row and its own match
+     * scores, so the rows after an unchanged result are skipped up to the next changed row.
+     */
+    template <typename TMatchScore>
+    size_t update(TMatchScore && matchScore, std::vector<bool> const & changedRows)
+    {
+        size_t recomputed = 0ul;
+        bool previousChanged = false;
+        for (size_t a = 0ul; a < lenA; ++a)
+        {
+            if (!previousChanged && !changedRows[a])
+                continue;
 
-                get(matrixV, a + 1, b + 1) = std::max({get(matrixM, a, b + 1) + go,
-                                                       get(matrixH, a, b + 1) + go,
-                                                       get(matrixV, a, b + 1) + ge});
-            }
+            previousChanged = computeRow(a, matchScore, 0ul, lenB);
+            ++recomputed;
         }
+        return recomputed;
     }
 
     ScoreType getPrefixScore(size_t posA, size_t posB)
@@ -126,8 +255,133 @@ public:
     {
         return getPrefixScore(lenA, lenB);
     }
+
+    /*!
+     * \brief Compute the trace of an optimal alignment.
+     * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+     * \details Gaps in the second sequence are HORIZONTAL and gaps in the first sequence are VERTICAL segments.
+     */
+    void traceback(TraceSegments & trace)
+    {
+        typedef seqan::TraceBitMap_<> TraceBitMap;
+        enum State { MATCH, GAP_A, GAP_B };
+        auto argmax = [] (ScoreType match, ScoreType gapA, ScoreType gapB)
+        {
+            return match >= gapA && match >= gapB ? MATCH : (gapA >= gapB ? GAP_A : GAP_B);
+        };
+
+        seqan::clear(trace);
+        size_t posA = lenA;
+        size_t posB = lenB;
+        State state = argmax(get(matrixM, posA, posB), get(matrixH, posA, posB), get(matrixV, posA, posB));
+        while (posA > 0ul && posB > 0ul)
+        {
+            if (state == MATCH)
+            {
+                --posA;
+                --posB;
+                seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::DIAGONAL));
+                state = argmax(get(matrixM, posA, posB), get(matrixH, posA, posB), get(matrixV, posA, posB));
+            }
+            else if (state == GAP_A) // matrix H: a position of the second sequence is aligned to a gap
+            {
+                --posB;
+                seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::VERTICAL));
+                state = argmax(get(matrixM, posA, posB) + gapOpen,
+                               get(matrixH, posA, posB) + gapExtend,
+                               get(matrixV, posA, posB) + gapOpen);
+            }
+            else // matrix V: a position of the first sequence is aligned to a gap
+            {
+                --posA;
+                seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::HORIZONTAL));
+                state = argmax(get(matrixM, posA, posB) + gapOpen,
+                               get(matrixH, posA, posB) + gapOpen,
+                               get(matrixV, posA, posB) + gapExtend);
+            }
+        }
+
+        // leading gaps
+        while (posA > 0ul)
+        {
+            --posA;
+            seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::HORIZONTAL));
+        }
+        while (posB > 0ul)
+        {
+            --posB;
+            seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::VERTICAL));
+        }
+    }
 };
 
+/*!
+ * \brief Compute an optimal alignment that contains the given matches.
+ * \param lengthA The length of the first sequence.
+ * \param lengthB The length of the second sequence.
+ * \param required The required matches (position in first, position in second sequence) in increasing order.
+ * \param matchScore Callable that returns the score for aligning the given positions.
+ * \param go The gap open score.
+ * \param ge The gap extend score.
+ * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+ * \return The score of the alignment, or -infinity if the required matches cross or cannot be aligned.
+ * \details
+ * A match closes any gap, so the alignment consists of independent Gotoh alignments of the sections between
+ * consecutive required matches.
+ */
+template <typename TMatchScore>
+ScoreType alignThrough(size_t lengthA, size_t lengthB, std::vector<PosPair> const & required,
+                       TMatchScore && matchScore, ScoreType go, ScoreType ge, TraceSegments & trace)
+{
+    typedef seqan::TraceBitMap_<> TraceBitMap;
+
+    seqan::clear(trace);
+    for (size_t idx = 0ul; idx < required.size(); ++idx)
+    {
+        bool const inRange = required[idx].first < lengthA && required[idx].second < lengthB;
+        bool const increasing = idx == 0ul || (required[idx - 1ul].first < required[idx].first &&
+                                               required[idx - 1ul].second < required[idx].second);
+        if (!inRange || !increasing)
+            return -infinity;
+    }
+
+    // Align the sections from the last to the first, such that the trace is stored from the end to the beginning.
+    int64_t total = 0;
+    TraceSegments sectionTrace;
+    for (size_t section = required.size() + 1ul; section > 0ul; --section)
+    {
+        PosPair const begin = section == 1ul ? PosPair{0ul, 0ul}
+                                             : PosPair{required[section - 2ul].first + 1ul,
+                                                       required[section - 2ul].second + 1ul};
+        PosPair const end = section > required.size() ? PosPair{lengthA, lengthB} : required[section - 1ul];
+
+        PairwiseGotoh gotoh(end.first - begin.first, end.second - begin.second,
+                            [&matchScore, begin] (size_t posA, size_t posB)
+                            {
+                                return matchScore(begin.first + posA, begin.second + posB);
+                            },
+                            go, ge);
+        total += gotoh.getOptimalScore();
+        gotoh.traceback(sectionTrace);
+        for (size_t idx = 0ul; idx < seqan::length(sectionTrace); ++idx)
+        {
+            TraceSegment const & segment = sectionTrace[idx];
+            seqan::appendValue(trace, TraceSegment(begin.first + segment._horizontalBeginPos,
+                                                   begin.second + segment._verticalBeginPos,
+                                                   segment._length, segment._traceValue));
+        }
+
+        // the required match in front of the section
+        if (section > 1ul)
+        {
+            PosPair const match = required[section - 2ul];
+            total += matchScore(match.first, match.second);
+            seqan::appendValue(trace, TraceSegment(match.first, match.second, 1u, TraceBitMap::DIAGONAL));
+        }
+    }
+    return total <= -infinity ? -infinity : static_cast<ScoreType>(std::min<int64_t>(total, infinity));
+}
+
 float generateEdges(std::vector<bool> & edges,          // OUT
                         seqan::Rna5String const & seqA,     // IN
                         seqan::Rna5String const & seqB,     // IN
@@ -157,4 +411,47 @@ float generateEdges(std::vector<bool> & edges,          // OUT
     return forward.getOptimalScore() / factor2int / std::max(lenA, lenB);
 }
 
+/*!
+ * \brief Align two sequences with their sequence scores only.
+ * \param seqA The first sequence.
+ * \param seqB The second sequence.
+ * \param params The parameters, which provide the scoring scheme and the library score.
+ * \param seqIndices The indices of the two sequences.
+ * \return The aligned columns with the weight of columns without a matched base pair, like getStructureLines().
+ * \details This is the fallback for pairs, whose structural alignment has not been started before the time limit.
+ */
+inline WeightedAlignedColumns sequenceAlignmentLines(seqan::Rna5String const & seqA, seqan::Rna5String const & seqB,
+                                                     Parameters const & params, PosPair const & seqIndices)
+{
+    typedef seqan::TraceBitMap_<> TraceBitMap;
+
+    PairwiseGotoh gotoh(seqA, seqB, params.rnaScore);
+    TraceSegments trace;
+    gotoh.traceback(trace);
+
+    bool const swapIdx = seqIndices.first > seqIndices.second;
+    unsigned const weight = params.libraryScoreIsLinear ? params.libraryScoreMin : 500u;
+    WeightedAlignedColumns structureLines{};
+    structureLines.first = swapIdx ? PosPair{seqIndices.second, seqIndices.first} : seqIndices;
+
+    // The trace segments are stored from the end to the beginning of the alignment.
+    for (size_t idx = seqan::length(trace); idx > 0ul; --idx)
+    {
+        TraceSegment const & segment = trace[idx - 1ul];
+        if (segment._traceValue != TraceBitMap::DIAGONAL)
+            continue;
+
+        for (size_t pos = 0ul; pos < segment._length; ++pos)
+        {
+            size_t const posA = segment._horizontalBeginPos + pos;
+            size_t const posB = segment._verticalBeginPos + pos;
+            if (swapIdx)
+                structureLines.second.emplace_back(posB, posA, weight);
+            else
+                structureLines.second.emplace_back(posA, posB, weight);
+        }
+    }
+    return structureLines;
+}
+
 } // namespace lara
@@ -40,6 +40,10 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <numeric>
 #include <set>
 #include <tuple>
 #include <unordered_map>
@@ -53,10 +57,12 @@
 #include <seqan/score.h>
 
 #include "data_types.hpp"
+#include "dual_store.hpp"
 #include "edge_filter.hpp"
 #include "parameters.hpp"
 #include "score.hpp"
 #include "matching.hpp"
+#include "sparse_alignment.hpp"
 
 namespace lara
 {
@@ -77,9 +83,13 @@ private:
     // the best structural alignment score found so far
     ScoreType bestStructuralAlignmentScore;
 
+    // number of subgradient iterations since the best alignment or its matching have changed
+    size_t stableRounds;
+
     struct EdgeManager
     {
         std::vector<bool> active{};
+        std::vector<size_t> ids{}; // indices of the active edges
         size_t size{};
         size_t dim{};
 
@@ -113,7 +123,13 @@ private:
         PriorityQueue::iterator queuePtr;
     };
 
-    std::vector<std::unordered_map<size_t, InteractionInfo>> interaction;
+    typedef std::unordered_map<size_t, InteractionInfo, std::hash<size_t>, std::equal_to<size_t>,
+                               NodeAllocator<std::pair<size_t const, InteractionInfo>>> InteractionMap;
+
+    // the nodes of the priority queues and the interaction maps are recycled within this object
+    std::shared_ptr<NodePool> nodePool{std::make_shared<NodePool>()};
+
+    std::vector<InteractionMap> interaction;
 
     // every alignment edge holds a priority queue that handles the possible partner edges
     // - the second argument denotes the index of the alignment edges
@@ -123,6 +139,44 @@ private:
     // mapping from the index of the dual variable to the pair of alignment edge indices
     std::vector<PosPair> dualToPairedEdges; // former _YToIndex
 
+    // buffers for the contacts of an alignment edge, kept for reuse
+    std::vector<Contact> headContact;
+    std::vector<Contact> tailContact;
+
+    // the columns of the active edges in each row of the score matrix
+    std::vector<PosPair> rowRanges;
+
+    // buffer for exchanging the dual values with the dual store
+    std::vector<DualRecord> dualRecords;
+
+    // the DP matrix of the last relaxed alignment and the rows of the score matrix that have changed since
+    std::unique_ptr<PairwiseGotoh> incrementalDP;
+    std::vector<bool> changedRows;
+
+    // the forward and backward DP matrices of the edge pruning and the edges that are kept, for reuse
+    std::unique_ptr<PairwiseGotoh> pruneForward;
+    std::unique_ptr<PairwiseGotoh> pruneBackward;
+    std::vector<bool> keepEdges;
+
+    // the sparse DP and its input
+    SparseAlignment sparse;
+    std::vector<SparseAlignment::Match> sparseMatches;
+
+    // buffers for the best relaxed score in each row and column of the score matrix
+    std::vector<ScoreType> rowBest;
+    std::vector<ScoreType> columnBest;
+
+    // the alignment edges of the last evaluated solution and their interactions with following edges of it
+    std::vector<size_t> solutionEdges;
+    std::vector<bool> inSolution;
+    std::unordered_map<size_t, std::vector<Contact>> solutionPartners;
+    std::vector<size_t> enteringEdges;
+    std::vector<size_t> leavingEdges;
+
+    // the interactions between the lines of the current alignment, and the matching that keeps its last result
+    std::vector<std::vector<Contact>> partners;
+    Matching matching;
+
     RnaScoreType * pssm;
     size_t seqIdx;
     float sequenceScaleFactor;
@@ -139,121 +193,216 @@ private:
 
     void adaptPriorityQ(PosPair pair, ScoreType value)
     {
+        changedRows[edges.source(pair.first)] = true;
         priorityQ[pair.first].erase(interaction[pair.first][pair.second].queuePtr);
         interaction[pair.first][pair.second].queuePtr = priorityQ[pair.first].emplace(-value, pair.second).first;
     }
 
-    // return gap score
-    ScoreType evaluateLines(std::pair<GappedSeq, GappedSeq> const & alignment, ScoreType gap_open, ScoreType gap_extend)
+    // Extract the lines from the DP trace and return the gap score.
+    ScoreType evaluateLines(TraceSegments const & trace, ScoreType gap_open, ScoreType gap_extend)
     {
-        // Get iterators.
-        auto it0    = seqan::begin(alignment.first);
-        auto itEnd0 = seqan::end(alignment.first);
-        auto it1    = seqan::begin(alignment.second);
-        auto itEnd1 = seqan::end(alignment.second);
-
-        // State whether we have already opened a gap.
-        bool isGapOpen0 = false;
-        bool isGapOpen1 = false;
+        typedef seqan::TraceBitMap_<> TraceBitMap;
 
-        // Keep track of the sequence positions for lines.
-        PosPair sourcePos(0ul, 0ul);
         lines.clear();
 
         // Sum up gap score.
         ScoreType gapScore = 0;
+        auto previousTrace = TraceBitMap::NONE;
 
-        while (it0 != itEnd0 && it1 != itEnd1)
+        // The trace segments are stored from the end to the beginning of the alignment.
+        for (size_t idx = seqan::length(trace); idx > 0ul; --idx)
         {
-            // Gaps in first sequence
-            if (seqan::isGap(it0))
+            TraceSegment const & segment = trace[idx - 1ul];
+            if (segment._length == 0)
+                continue;
+
+            if (segment._traceValue == TraceBitMap::DIAGONAL)
             {
-                if (!isGapOpen0)
-                {
-                    gapScore += gap_open;
-                }
-                else
-                {
-                    gapScore += gap_extend;
-                }
-                isGapOpen0 = true;
-                ++sourcePos.second;
+                // create a line for each match or mismatch
+                for (size_t pos = 0ul; pos < segment._length; ++pos)
+                    lines.emplace_back(segment._horizontalBeginPos + pos, segment._verticalBeginPos + pos);
             }
             else
             {
-                isGapOpen0 = false;
+                // gap in one of the sequences: open it, unless the previous segment has the same direction
+                SEQAN_ASSERT(segment._traceValue == TraceBitMap::HORIZONTAL
+                             || segment._traceValue == TraceBitMap::VERTICAL);
+                gapScore += (segment._traceValue == previousTrace ? gap_extend : gap_open)
+                            + static_cast<ScoreType>(segment._length - 1) * gap_extend;
             }
+            previousTrace = segment._traceValue;
+        }
+        return gapScore;
+    }
+
+    inline ScoreType getSeqScore(SeqScoreMatrix const & mat, size_t idx)
+    {
+        return sequenceScaleFactor * seqan::score(mat, sequenceA[edges.source(idx)], sequenceB[edges.target(idx)]);
+    }
+
+    //!\brief Forget the last evaluated solution, e.g. after the interactions have changed.
+    void resetSolution()
+    {
+        solutionEdges.clear();
+        inSolution.assign(edges.size, false);
+        solutionPartners.clear();
+    }
+
+    //!\brief Insert an interaction into the partner list of an alignment edge, which is sorted by the partner.
+    void addSolutionPartner(size_t edgeIdx, ScoreType score, size_t partnerIdx)
+    {
+        std::vector<Contact> & list = solutionPartners[edgeIdx];
+        auto pos = std::lower_bound(list.begin(), list.end(), partnerIdx,
+                                    [] (Contact const & contact, size_t idx) { return contact.second < idx; });
+        list.emplace(pos, score, partnerIdx);
+    }
 
-            // Gaps in second sequence
-            if (seqan::isGap(it1))
+    /*!
+     * \brief Update the set of alignment edges in the solution and the interactions between them.
+     * \param alignment The sorted alignment edges of the new solution.
+     * \details
+     * Each edge of the solution holds its interactions with the following edges of the solution. Only the edges
+     * that enter or leave the solution are processed, such that the effort depends on the changes and not on the
+     * number of interactions of all edges. This relies on the interactions being defined in both directions.
+     */
+    void updateSolution(std::vector<size_t> const & alignment)
+    {
+        enteringEdges.clear();
+        leavingEdges.clear();
+        std::set_difference(alignment.begin(), alignment.end(), solutionEdges.begin(), solutionEdges.end(),
+                            std::back_inserter(enteringEdges));
+        std::set_difference(solutionEdges.begin(), solutionEdges.end(), alignment.begin(), alignment.end(),
+                            std::back_inserter(leavingEdges));
+
+        for (size_t edgeIdx : leavingEdges)
+        {
+            inSolution[edgeIdx] = false;
+            solutionPartners.erase(edgeIdx);
+        }
+        for (size_t edgeIdx : leavingEdges)
+        {
+            for (auto const & entry : interaction[edgeIdx])
             {
-                if (!isGapOpen1)
+                if (entry.first > edgeIdx || !inSolution[entry.first])
+                    continue;
+
+                std::vector<Contact> & list = solutionPartners[entry.first];
+                auto pos = std::find_if(list.begin(), list.end(),
+                                        [edgeIdx] (Contact const & contact) { return contact.second == edgeIdx; });
+                if (pos != list.end())
+                    list.erase(pos);
+            }
+        }
+
+        for (size_t edgeIdx : enteringEdges)
+            inSolution[edgeIdx] = true;
+        for (size_t edgeIdx : enteringEdges)
+        {
+            for (auto const & entry : interaction[edgeIdx])
+            {
+                size_t const partnerIdx = entry.first;
+                if (!inSolution[partnerIdx])
+                    continue;
+
+                if (edgeIdx < partnerIdx)
                 {
-                    gapScore += gap_open;
+                    addSolutionPartner(edgeIdx, entry.second.score, partnerIdx);
                 }
-                else
+                else if (!std::binary_search(enteringEdges.begin(), enteringEdges.end(), partnerIdx))
                 {
-                    gapScore += gap_extend;
+                    // an entering partner adds the interaction itself
+                    auto reverseIt = interaction[partnerIdx].find(edgeIdx);
+                    if (reverseIt != interaction[partnerIdx].end())
+                        addSolutionPartner(partnerIdx, reverseIt->second.score, edgeIdx);
                 }
-                isGapOpen1 = true;
-                ++sourcePos.first;
             }
-            else
-            {
-                isGapOpen1 = false;
-            }
-
-            // Match or mismatch
-            if (!seqan::isGap(it0) && !seqan::isGap(it1))
-            {
-                // create a line
-                lines.push_back(sourcePos);
-                ++sourcePos.first;
-                ++sourcePos.second;
-            }
-
-            ++it0;
-            ++it1;
         }
-        SEQAN_ASSERT(it0 == itEnd0);
-        SEQAN_ASSERT(it1 == itEnd1);
-        return gapScore;
+        solutionEdges = alignment;
     }
 
-    inline ScoreType getSeqScore(SeqScoreMatrix const & mat, size_t idx)
+public:
+    Lagrange(seqan::RnaRecord const & recordA, seqan::RnaRecord const & recordB,
+             Parameters const & params, RnaScoreType * score, size_t sidx) : pssm(nullptr), seqIdx(0ul)
     {
-        return sequenceScaleFactor * seqan::score(mat, sequenceA[edges.source(idx)], sequenceB[edges.target(idx)]);
+        reset(recordA, recordB, params);
+        bind(score, sidx);
     }
 
-public:
-    Lagrange(seqan::RnaRecord const & recordA, seqan::RnaRecord const & recordB,
-             Parameters const & params, RnaScoreType * score, size_t sidx) : pssm(score), seqIdx(sidx)
+    // The node pool is owned by the object and moves with the containers that allocate from it.
+    Lagrange(Lagrange const &)             = delete;
+    Lagrange(Lagrange &&)                  = default;
+    Lagrange & operator=(Lagrange const &) = delete;
+    Lagrange & operator=(Lagrange &&)      = default;
+
+    /*!
+     * \brief Prepare the object for the alignment of a new pair of sequences.
+     * \param recordA The first RNA record.
+     * \param recordB The second RNA record.
+     * \param params The LaRA parameters.
+     * \details
+     * The data of the previous pair is discarded, but the containers keep their memory for reuse. The score matrix
+     * is not touched, call bind() to write the initial scores.
+     */
+    void reset(seqan::RnaRecord const & recordA, seqan::RnaRecord const & recordB, Parameters const & params)
     {
         _LOG(3, "     " << recordA.sequence << "\n     " << recordB.sequence << std::endl);
-        sequenceA = seqan::Rna5String{recordA.sequence};
-        sequenceB = seqan::Rna5String{recordB.sequence};
+
+        // only the active edges of the previous pair hold data
+        for (size_t edgeIdx : edges.ids)
+        {
+            priorityQ[edgeIdx].clear();
+            interaction[edgeIdx].clear();
+        }
+        dualToPairedEdges.clear();
+        bestStructuralAlignment.clear();
+        edgeMatching.clear();
+        lines.clear();
+        solutionEdges.clear();
+        solutionPartners.clear();
+
+        sequenceA = recordA.sequence;
+        sequenceB = recordB.sequence;
         PosPair seqLen{seqan::length(sequenceA), seqan::length(sequenceB)};
 
         // score of best alignment
         bestStructuralAlignmentScore = -infinity;
+        stableRounds = 0ul;
 
-        // the following things have to be done in the constructor
+        // the following things have to be done for each pair of sequences
         // - given the two RNA structures, determine possible partner edges
         // - compute a set of alignment edges between the RNA structures
         // - initialize the priority queues according to the scores given
         // - provide a mapping between indices (indexing the dual variables
         //   and the actual pair of alignment edges
 
-        edges.active.resize(seqLen.first * seqLen.second);
+        edges.active.assign(seqLen.first * seqLen.second, false);
         edges.size = edges.active.size();
         edges.dim = seqLen.second;
         float const avSeqId = generateEdges(edges.active, sequenceA, sequenceB, params.rnaScore,
                                             static_cast<ScoreType>(params.suboptimalDiff * factor2int));
         sequenceScaleFactor = params.balance * avSeqId + params.sequenceScale;
 
-        priorityQ.resize(edges.size);
-        interaction.resize(edges.size);
+        edges.ids.clear();
+        for (size_t edgeIdx = 0ul; edgeIdx < edges.size; ++edgeIdx)
+        {
+            if (edges.active[edgeIdx])
+                edges.ids.push_back(edgeIdx);
+        }
+
+        // the queues are never shrunk, such that their memory can be reused for the next pair
+        if (priorityQ.size() < edges.size)
+        {
+            priorityQ.resize(edges.size, PriorityQueue(NodeAllocator<Contact>(nodePool)));
+            interaction.resize(edges.size, InteractionMap(0ul, InteractionMap::hasher(), InteractionMap::key_equal(),
+                                                          InteractionMap::allocator_type(nodePool)));
+        }
         dualToPairedEdges.reserve(edges.size);
+        inSolution.assign(edges.size, false);
+        matching.setTimeTarget(params.matchingTime);
+        incrementalDP.reset();
+        pruneForward.reset();
+        pruneBackward.reset();
+        changedRows.assign(seqLen.first, false);
 
         // start
 
@@ -266,8 +415,8 @@ public:
             ScoreType alignScore = getSeqScore(params.rnaScore, edgeIdx);
             priorityQ[edgeIdx].emplace(-alignScore, edgeIdx);
 
-            std::vector<Contact> headContact;
-            std::vector<Contact> tailContact;
+            headContact.clear();
+            tailContact.clear();
             extractContacts(headContact, seqan::front(recordA.bppMatrGraphs), edges.source(edgeIdx));
             extractContacts(tailContact, seqan::front(recordB.bppMatrGraphs), edges.target(edgeIdx));
 
@@ -295,14 +444,419 @@ public:
             }
         }
 
+    }
+
+    /*!
+     * \brief Attach the object to a lane of a score matrix and write the initial scores.
+     * \param score The score matrix, whose lane has been reset by the caller. Nothing is written if it is nullptr.
+     * \param sidx The lane of the score matrix.
+     */
+    void bind(RnaScoreType * score, size_t sidx)
+    {
+        pssm = score;
+        seqIdx = sidx;
+        if (pssm == nullptr)
+            return;
+
+        // The edge indices are sorted by row and column.
+        rowRanges.assign(seqan::length(sequenceA), PosPair{0ul, 0ul});
+        for (size_t edgeIdx : edges.ids)
+        {
+            PosPair & range = rowRanges[edges.source(edgeIdx)];
+            if (range.first == range.second)
+                range.first = edges.target(edgeIdx);
+            range.second = edges.target(edgeIdx) + 1ul;
+        }
+        pssm->bind(seqIdx, rowRanges);
+
         // filling the matrix, we're updating the values afterwards, otherwise
         // we had to evaluate _maxProfitScores after every update of either the
         // l or m edge
-        for (size_t edgeIdx = 0ul; edgeIdx < edges.size; ++edgeIdx)
+        for (size_t edgeIdx : edges.ids)
+            pssm->set(seqIdx, edges.source(edgeIdx), edges.target(edgeIdx), -priorityQ[edgeIdx].begin()->first);
+    }
+
+    /*!
+     * \brief Detach the object from its score matrix lane.
+     * \details Only the cells of the active edges have been written, so only these are set back to their initial value.
+     */
+    void unbind()
+    {
+        if (pssm != nullptr)
         {
-            if (edges.active[edgeIdx])
-                pssm->set(seqIdx, edges.source(edgeIdx), edges.target(edgeIdx), -priorityQ[edgeIdx].begin()->first);
+            for (size_t edgeIdx : edges.ids)
+                pssm->unset(seqIdx, edges.source(edgeIdx), edges.target(edgeIdx));
+            pssm->unbind(seqIdx);
+        }
+        pssm = nullptr;
+    }
+
+    /*!
+     * \brief Initialise the dual variables with the values of previous alignments of the same sequences.
+     * \param dual The dual variables, all zero.
+     * \param dualStore The memory of previous dual values.
+     * \param sequenceIndices The indices of the two sequences.
+     * \param mat The sequence score matrix.
+     * \return The number of initialised dual variables.
+     * \details Must be called before bind(), as only the priority queues are updated.
+     */
+    size_t warmStart(std::vector<ScoreType> & dual, DualStore & dualStore, PosPair sequenceIndices,
+                     SeqScoreMatrix const & mat)
+    {
+        dualRecords.clear();
+        for (PosPair const & pair : dualToPairedEdges)
+        {
+            PosPair const pairA{edges.source(pair.first), edges.source(pair.second)};
+            PosPair const pairB{edges.target(pair.first), edges.target(pair.second)};
+            dualRecords.push_back({pairA, pairB, DualStore::context(sequenceA, sequenceB, pairA, pairB), 0.0f, false});
+        }
+        dualStore.estimate(sequenceIndices, dualRecords);
+
+        size_t count = 0ul;
+        for (size_t dualIdx = 0ul; dualIdx < dualRecords.size(); ++dualIdx)
+        {
+            if (!dualRecords[dualIdx].known)
+                continue;
+
+            PosPair const pair = dualToPairedEdges[dualIdx];
+            dual[dualIdx] = static_cast<ScoreType>(dualRecords[dualIdx].value);
+            ScoreType const newScore = getSeqScore(mat, pair.first) + interaction[pair.first][pair.second].score
+                                       + dual[dualIdx];
+            adaptPriorityQ(pair, newScore);
+            ++count;
+        }
+        return count;
+    }
+
+    /*!
+     * \brief Add the final dual values of a converged alignment to the dual store.
+     * \param dual The dual variables.
+     * \param dualStore The memory of previous dual values.
+     * \param sequenceIndices The indices of the two sequences.
+     */
+    void recordDuals(std::vector<ScoreType> const & dual, DualStore & dualStore, PosPair sequenceIndices)
+    {
+        dualRecords.clear();
+        for (size_t dualIdx = 0ul; dualIdx < dualToPairedEdges.size(); ++dualIdx)
+        {
+            PosPair const & pair = dualToPairedEdges[dualIdx];
+            if (!edges.active[pair.first] || !edges.active[pair.second])
+                continue; // pruned
+
+            PosPair const pairA{edges.source(pair.first), edges.source(pair.second)};
+            PosPair const pairB{edges.target(pair.first), edges.target(pair.second)};
+            dualRecords.push_back({pairA, pairB, DualStore::context(sequenceA, sequenceB, pairA, pairB),
+                                   static_cast<float>(dual[dualIdx]), true});
+        }
+        dualStore.record(sequenceIndices, dualRecords);
+    }
+
+    /*!
+     * \brief Compute a valid solution from the fixed (MFE) structures of both sequences.
+     * \param recordA The first RNA record.
+     * \param recordB The second RNA record.
+     * \param subgradient The subgradient vector, which is left unchanged.
+     * \param subgradientIndices Buffer for the subgradient indices, which is left empty.
+     * \param lookahead The matching algorithm, see Parameters::matching.
+     * \param mat The sequence score matrix.
+     * \return The score of the solution, or -infinity if a record has no fixed structure.
+     * \details
+     * An alignment edge scores its sequence score plus the interaction with the edge that connects the fixed base
+     * pair partners of its positions. The optimal alignment for these scores is evaluated like any relaxed solution,
+     * so that it becomes the best solution if it scores higher.
+     */
+    ScoreType primalHeuristic(seqan::RnaRecord const & recordA, seqan::RnaRecord const & recordB,
+                              std::vector<float> & subgradient, std::list<size_t> & subgradientIndices,
+                              int lookahead, SeqScoreMatrix const & mat)
+    {
+        if (seqan::empty(recordA.fixedGraphs) || seqan::empty(recordB.fixedGraphs))
+            return -infinity;
+
+        size_t const lenA = seqan::length(sequenceA);
+        size_t const lenB = seqan::length(sequenceB);
+        auto fixedPartners = [] (std::vector<size_t> & partners, seqan::RnaStructureGraph const & graph, size_t len)
+        {
+            partners.assign(len, len); // unpaired
+            for (size_t pos = 0ul; pos < len; ++pos)
+            {
+                seqan::RnaAdjacencyIterator adjIt(graph.inter, pos);
+                if (!seqan::atEnd(adjIt))
+                    partners[pos] = seqan::value(adjIt);
+            }
+        };
+        std::vector<size_t> partnersA;
+        std::vector<size_t> partnersB;
+        fixedPartners(partnersA, seqan::front(recordA.fixedGraphs), lenA);
+        fixedPartners(partnersB, seqan::front(recordB.fixedGraphs), lenB);
+
+        auto heuristicScore = [&] (size_t posA, size_t posB)
+        {
+            size_t const edgeIdx = edges.index(posA, posB);
+            if (!edges.active[edgeIdx])
+                return -infinity;
+
+            ScoreType result = getSeqScore(mat, edgeIdx);
+            if (partnersA[posA] < lenA && partnersB[posB] < lenB)
+            {
+                auto it = interaction[edgeIdx].find(edges.index(partnersA[posA], partnersB[posB]));
+                if (it != interaction[edgeIdx].end())
+                    result += it->second.score;
+            }
+            return result;
+        };
+        PairwiseGotoh gotoh(lenA, lenB, heuristicScore, mat.data_gap_open, mat.data_gap_extend);
+        TraceSegments trace;
+        gotoh.traceback(trace);
+
+        ScoreType const primalValue = evaluateSolution(subgradient, subgradientIndices, trace, lookahead, mat);
+        for (size_t si : subgradientIndices)
+            subgradient[si] = 0.0f;
+        subgradientIndices.clear();
+        _LOG(3, "     heuristic primal " << primalValue << std::endl);
+        return primalValue;
+    }
+
+    /*!
+     * \brief Remove the alignment edges that cannot be part of a solution better than the given lower bound.
+     * \param bestLower The score of the best valid solution found so far.
+     * \param mat The sequence score matrix, which provides the gap scores.
+     * \return The number of removed alignment edges.
+     * \details
+     * The relaxed score of the best alignment through an edge is an upper bound for every valid solution that
+     * contains the edge. It is the sum of the best prefix score, the edge score and the best suffix score, which
+     * are computed with a forward and a backward DP over the current relaxed scores. The edges of the best
+     * structural alignment are never removed. The interactions of removed edges are erased on both sides.
+     */
+    size_t pruneEdges(ScoreType bestLower, SeqScoreMatrix const & mat)
+    {
+        size_t const lenA = seqan::length(sequenceA);
+        size_t const lenB = seqan::length(sequenceB);
+        auto relaxedScore = [this] (size_t posA, size_t posB) { return getRelaxedScore(posA, posB); };
+        auto reverseScore = [&relaxedScore, lenA, lenB] (size_t posA, size_t posB)
+        {
+            return relaxedScore(lenA - posA - 1ul, lenB - posB - 1ul);
+        };
+        if (!pruneForward)
+        {
+            pruneForward.reset(new PairwiseGotoh(lenA, lenB, relaxedScore, mat.data_gap_open, mat.data_gap_extend));
+            pruneBackward.reset(new PairwiseGotoh(lenA, lenB, reverseScore, mat.data_gap_open, mat.data_gap_extend));
+        }
+        else
+        {
+            pruneForward->compute(relaxedScore);
+            pruneBackward->compute(reverseScore);
+        }
+        PairwiseGotoh & forward = *pruneForward;
+        PairwiseGotoh & backward = *pruneBackward;
+
+        keepEdges.assign(edges.size, false);
+        for (size_t edgeIdx : bestStructuralAlignment)
+            keepEdges[edgeIdx] = true;
+
+        size_t removed = 0ul;
+        for (size_t edgeIdx : edges.ids)
+        {
+            size_t const posA = edges.source(edgeIdx);
+            size_t const posB = edges.target(edgeIdx);
+            int64_t const bound = static_cast<int64_t>(forward.getPrefixScore(posA, posB))
+                                  + relaxedScore(posA, posB)
+                                  + backward.getPrefixScore(lenA - posA - 1ul, lenB - posB - 1ul);
+            if (keepEdges[edgeIdx] || bound >= bestLower)
+                continue;
+
+            // erase the interactions on the partner's side and update its score
+            for (auto const & entry : interaction[edgeIdx])
+            {
+                size_t const partnerIdx = entry.first;
+                auto partnerIt = interaction[partnerIdx].find(edgeIdx);
+                if (partnerIt == interaction[partnerIdx].end())
+                    continue;
+
+                priorityQ[partnerIdx].erase(partnerIt->second.queuePtr);
+                interaction[partnerIdx].erase(partnerIt);
+                changedRows[edges.source(partnerIdx)] = true;
+                if (edges.active[partnerIdx] && pssm != nullptr)
+                    pssm->set(seqIdx, edges.source(partnerIdx), edges.target(partnerIdx),
+                              -priorityQ[partnerIdx].begin()->first);
+            }
+
+            interaction[edgeIdx].clear();
+            priorityQ[edgeIdx].clear();
+            edges.active[edgeIdx] = false;
+            changedRows[posA] = true;
+            if (pssm != nullptr)
+                pssm->unset(seqIdx, posA, posB);
+            ++removed;
+        }
+
+        if (removed > 0ul)
+        {
+            resetSolution();
+            edges.ids.erase(std::remove_if(edges.ids.begin(), edges.ids.end(),
+                                           [this] (size_t edgeIdx) { return !edges.active[edgeIdx]; }),
+                            edges.ids.end());
+        }
+        _LOG(3, "     pruned " << removed << " alignment edges, " << edges.ids.size() << " remaining" << std::endl);
+        return removed;
+    }
+
+    /*!
+     * \brief Close the gap between the bounds with a best-first branch and bound on the interactions.
+     * \param bestUpper The best upper bound of the subgradient optimisation.
+     * \param maxNodes The maximal number of nodes to be evaluated.
+     * \param epsilon The distance of the bounds that means equality.
+     * \param subgradient Buffer for evaluating solutions, which is reset afterwards.
+     * \param subgradientIndices Buffer for evaluating solutions, which is cleared afterwards.
+     * \param lookahead The matching algorithm, see Parameters::matching.
+     * \param mat The sequence score matrix, which provides the gap scores.
+     * \return The upper bound after the search, which is at most bestUpper.
+     * \details
+     * A node forbids some interactions and requires some alignment edges. Its upper bound is the relaxed score with
+     * the current dual values, where the best partner of an edge skips the forbidden interactions and the partners
+     * that conflict with a required edge, and where the alignment passes through all required edges. The relaxed
+     * solution of a node is evaluated like in the subgradient optimisation and may improve the best structural
+     * alignment. A node is split on an interaction of its relaxed solution that is not reciprocated: one child
+     * forbids the interaction, the other requires both of its alignment edges.
+     */
+    ScoreType branchAndBound(ScoreType bestUpper, size_t maxNodes, ScoreType epsilon, std::vector<float> & subgradient,
+                             std::list<size_t> & subgradientIndices, int lookahead, SeqScoreMatrix const & mat)
+    {
+        struct Node
+        {
+            std::vector<size_t> forbidden; // sorted dual indices of the forbidden interactions
+            std::vector<size_t> required;  // sorted indices of the required alignment edges
+            ScoreType bound;
+            TraceSegments trace;
+        };
+        auto lessBound = [] (Node const & lhs, Node const & rhs) { return lhs.bound < rhs.bound; };
+
+        // the best entry in the priority queue of an edge that is allowed in the node
+        auto nodeHead = [this] (Node const & node, size_t edgeIdx) -> Contact const &
+        {
+            for (Contact const & entry : priorityQ[edgeIdx])
+            {
+                size_t const partnerIdx = entry.second;
+                if (partnerIdx == edgeIdx)
+                    return entry; // unpaired
+
+                size_t const dualIdx = interaction[edgeIdx].at(partnerIdx).dualIdx;
+                if (std::binary_search(node.forbidden.begin(), node.forbidden.end(), dualIdx))
+                    continue;
+
+                if (std::all_of(node.required.begin(), node.required.end(), [this, partnerIdx] (size_t requiredIdx)
+                    {
+                        return requiredIdx == partnerIdx || edges.nonCrossing(requiredIdx, partnerIdx);
+                    }))
+                    return entry;
+            }
+            return *priorityQ[edgeIdx].begin(); // not reached, because the edge itself is in the queue
+        };
+
+        size_t const lenA = seqan::length(sequenceA);
+        size_t const lenB = seqan::length(sequenceB);
+        std::vector<PosPair> requiredCells{};
+        auto evaluate = [&] (Node & node)
+        {
+            requiredCells.clear();
+            for (size_t edgeIdx : node.required)
+                requiredCells.emplace_back(edges.source(edgeIdx), edges.target(edgeIdx));
+
+            node.bound = alignThrough(lenA, lenB, requiredCells,
+                                      [&] (size_t posA, size_t posB)
+                                      {
+                                          size_t const edgeIdx = edges.index(posA, posB);
+                                          return edges.active[edgeIdx] ? -nodeHead(node, edgeIdx).first : -infinity;
+                                      },
+                                      mat.data_gap_open, mat.data_gap_extend, node.trace);
+        };
+        auto closed = [this, epsilon] (ScoreType bound)
+        {
+            return static_cast<int64_t>(bound) - bestStructuralAlignmentScore <= epsilon;
+        };
+
+        std::vector<Node> open(1ul);
+        evaluate(open.front());
+        ScoreType leafUpper = -infinity;
+        size_t numNodes = 0ul;
+
+        while (!open.empty() && numNodes < maxNodes)
+        {
+            std::pop_heap(open.begin(), open.end(), lessBound);
+            Node node = std::move(open.back());
+            open.pop_back();
+
+            // All open nodes have a smaller bound, so the best solution is optimal.
+            if (closed(node.bound))
+            {
+                open.clear();
+                break;
+            }
+            ++numNodes;
+
+            evaluateSolution(subgradient, subgradientIndices, node.trace, lookahead, mat);
+            for (size_t si : subgradientIndices)
+                subgradient[si] = 0.0f;
+            subgradientIndices.clear();
+
+            // select the non-reciprocated interaction with the highest score, inSolution marks the lines
+            size_t branchIdx = edges.size;
+            size_t branchPartner = edges.size;
+            for (PosPair line : lines)
+            {
+                size_t const edgeIdx = edges.index(line.first, line.second);
+                size_t const partnerIdx = nodeHead(node, edgeIdx).second;
+                if (partnerIdx == edgeIdx || (inSolution[partnerIdx] && nodeHead(node, partnerIdx).second == edgeIdx))
+                    continue;
+
+                if (branchIdx == edges.size ||
+                    interaction[edgeIdx].at(partnerIdx).score > interaction[branchIdx].at(branchPartner).score)
+                {
+                    branchIdx = edgeIdx;
+                    branchPartner = partnerIdx;
+                }
+            }
+
+            // The relaxed solution is consistent, so its bound cannot be tightened by branching.
+            if (branchIdx == edges.size)
+            {
+                leafUpper = std::max(leafUpper, node.bound);
+                continue;
+            }
+
+            // child that forbids the interaction in both directions
+            Node forbidChild{node.forbidden, node.required, -infinity, TraceSegments{}};
+            forbidChild.forbidden.push_back(interaction[branchIdx].at(branchPartner).dualIdx);
+            auto reverseIt = interaction[branchPartner].find(branchIdx);
+            if (reverseIt != interaction[branchPartner].end())
+                forbidChild.forbidden.push_back(reverseIt->second.dualIdx);
+            std::sort(forbidChild.forbidden.begin(), forbidChild.forbidden.end());
+
+            // child that requires both alignment edges of the interaction
+            Node requireChild{std::move(node.forbidden), std::move(node.required), -infinity, TraceSegments{}};
+            for (size_t edgeIdx : {branchIdx, branchPartner})
+            {
+                auto pos = std::lower_bound(requireChild.required.begin(), requireChild.required.end(), edgeIdx);
+                if (pos == requireChild.required.end() || *pos != edgeIdx)
+                    requireChild.required.insert(pos, edgeIdx);
+            }
+
+            for (Node * child : {&forbidChild, &requireChild})
+            {
+                evaluate(*child);
+                if (!closed(child->bound))
+                {
+                    open.push_back(std::move(*child));
+                    std::push_heap(open.begin(), open.end(), lessBound);
+                }
+            }
         }
+
+        ScoreType upperBound = std::max(bestStructuralAlignmentScore, leafUpper);
+        if (!open.empty())
+            upperBound = std::max(upperBound, open.front().bound);
+        _LOG(2, "     branch and bound: " << numNodes << " nodes, bounds " << bestStructuralAlignmentScore << " "
+                << std::min(upperBound, bestUpper) << std::endl);
+        return std::min(upperBound, bestUpper);
     }
 
     void updateScores(std::vector<ScoreType> & dual, std::list<size_t> const & dualIndices, SeqScoreMatrix const & mat)
@@ -310,29 +864,46 @@ public:
         for (size_t dualIdx : dualIndices)
         {
             PosPair pair = dualToPairedEdges[dualIdx]; // (l,m)
+            if (!edges.active[pair.first] || !edges.active[pair.second])
+                continue; // pruned
             ScoreType const newScore = getSeqScore(mat, pair.first) + interaction[pair.first][pair.second].score + dual[dualIdx];
             adaptPriorityQ(pair, newScore);
-            pssm->set(seqIdx, edges.source(pair.first), edges.target(pair.first), -priorityQ[pair.first].begin()->first);
+            if (pssm != nullptr)
+                pssm->set(seqIdx, edges.source(pair.first), edges.target(pair.first),
+                          -priorityQ[pair.first].begin()->first);
         }
     }
 
+    /*!
+     * \brief Evaluate the relaxed alignment of a subgradient iteration as a valid solution.
+     * \details Counts the iteration for the stable rounds criterion, see evaluateSolution for the parameters.
+     */
     ScoreType valid_solution(std::vector<float> & subgradient, std::list<size_t> & subgradientIndices,
-                             std::pair<GappedSeq, GappedSeq> const & alignment, unsigned lookahead,
-                             SeqScoreMatrix const & mat)
+                             TraceSegments const & trace, int lookahead, SeqScoreMatrix const & mat)
     {
-        ScoreType gapScore = evaluateLines(alignment, mat.data_gap_open, mat.data_gap_extend);
+        ++stableRounds;
+        return evaluateSolution(subgradient, subgradientIndices, trace, lookahead, mat);
+    }
 
-        std::vector<size_t> currentStructuralAlignment;
-        std::vector<bool> inSolution;
-        inSolution.resize(edges.size, false);
+    /*!
+     * \brief Compute the subgradient and the score of the best valid solution for an alignment trace.
+     * \details
+     * Keeps the solution if it is the best so far. Unlike valid_solution, this does not count as a round of the
+     * stable rounds criterion, such that the primal heuristic and the branch and bound only reset the counter.
+     */
+    ScoreType evaluateSolution(std::vector<float> & subgradient, std::list<size_t> & subgradientIndices,
+                               TraceSegments const & trace, int lookahead, SeqScoreMatrix const & mat)
+    {
+        ScoreType gapScore = evaluateLines(trace, mat.data_gap_open, mat.data_gap_extend);
 
+        std::vector<size_t> currentStructuralAlignment;
         for (PosPair line : lines)
         {
             size_t edgeIdx = edges.index(line.first, line.second);
             SEQAN_ASSERT_MSG(edges.active[edgeIdx], "Alignment match where no alignment edge is defined!");
             currentStructuralAlignment.push_back(edgeIdx);
-            inSolution[edgeIdx] = true;
         }
+        updateSolution(currentStructuralAlignment);
 
         subgradientIndices.clear();
         for (size_t idx : currentStructuralAlignment)
@@ -376,19 +947,21 @@ public:
         std::unordered_map<size_t, size_t> contacts{};
         if (!subgradientIndices.empty())
         {
-            std::vector<std::vector<Contact>> partners{};
             partners.resize(currentStructuralAlignment.size());
             for (size_t idx = 0ul; idx < currentStructuralAlignment.size(); ++idx)
             {
-                size_t line = currentStructuralAlignment[idx];
-                for (auto const & it : priorityQ[line])
-                    if (inSolution[it.second] && line < it.second)
-                        partners[idx].emplace_back(interaction[line][it.second].score, it.second);
+                auto listIt = solutionPartners.find(currentStructuralAlignment[idx]);
+                if (listIt != solutionPartners.end())
+                    partners[idx] = listIt->second;
+                else
+                    partners[idx].clear();
             }
 
-            Matching mwm(partners, lookahead);
-            lowerBound += mwm.computeScore(currentStructuralAlignment);
-            contacts = mwm.getContacts();
+            lowerBound += matching.computeScore(currentStructuralAlignment, partners, lookahead);
+
+            // the contacts are only needed if the solution improves
+            if (lowerBound + gapScore > bestStructuralAlignmentScore)
+                contacts = matching.getContacts();
         }
         else
         {
@@ -420,6 +993,9 @@ public:
         // store the best alignment found so far
         if (primalValue > bestStructuralAlignmentScore)
         {
+            if (currentStructuralAlignment != bestStructuralAlignment || contacts != edgeMatching)
+                stableRounds = 0ul;
+
             bestStructuralAlignmentScore = primalValue;
             bestStructuralAlignment = currentStructuralAlignment;
             edgeMatching = contacts;
@@ -427,11 +1003,153 @@ public:
         return primalValue;
     }
 
+    //!\brief Return the score of the best structural alignment found so far.
+    ScoreType getPrimalScore() const
+    {
+        return bestStructuralAlignmentScore;
+    }
+
+    //!\brief Return the number of subgradient iterations since the best alignment or its matching have changed.
+    size_t getStableRounds() const
+    {
+        return stableRounds;
+    }
+
     size_t getDimension()
     {
         return dimension;
     }
 
+    //!\brief Estimate the memory in bytes of the edges and interactions of the current pair.
+    size_t memoryEstimate() const
+    {
+        // each interaction has a node in the queue and in the map of both its edges
+        size_t const nodeSize = sizeof(Contact) + sizeof(InteractionMap::value_type) + 4ul * sizeof(void *);
+        return edges.size * (sizeof(PriorityQueue) + sizeof(InteractionMap) + sizeof(PosPair))
+               + 2ul * dimension * nodeSize;
+    }
+
+    //!\brief Return the fraction of the cells of the DP matrix that have an active alignment edge.
+    float edgeDensity() const
+    {
+        return edges.size == 0ul ? 1.0f : static_cast<float>(edges.ids.size()) / edges.size;
+    }
+
+    //!\brief Whether the matrices of the incremental DP fit into the given number of megabytes.
+    bool incrementalFits(size_t megabytes) const
+    {
+        size_t const cells = (seqan::length(sequenceA) + 1ul) * (seqan::length(sequenceB) + 1ul);
+        return 3ul * cells * sizeof(ScoreType) <= (megabytes << 20);
+    }
+
+    /*!
+     * \brief Compute the relaxed alignment with a DP that only recomputes the rows whose scores have changed.
+     * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+     * \param mat The sequence score matrix, which provides the gap scores.
+     * \return The score of the relaxed alignment.
+     * \details
+     * The DP matrix is kept between the calls. The rows of the changed scores are recorded by the updates and the
+     * pruning, and the DP resumes at the first of them.
+     */
+    ScoreType incrementalRelaxedAlignment(TraceSegments & trace, SeqScoreMatrix const & mat)
+    {
+        auto relaxedScore = [this] (size_t posA, size_t posB) { return getRelaxedScore(posA, posB); };
+        if (!incrementalDP)
+        {
+            incrementalDP.reset(new PairwiseGotoh(seqan::length(sequenceA), seqan::length(sequenceB), relaxedScore,
+                                                  mat.data_gap_open, mat.data_gap_extend));
+        }
+        else
+        {
+            size_t const rows = incrementalDP->update(relaxedScore, changedRows);
+            _LOG(3, "     recomputed " << rows << " of " << changedRows.size() << " DP rows" << std::endl);
+        }
+        std::fill(changedRows.begin(), changedRows.end(), false);
+        incrementalDP->traceback(trace);
+        return incrementalDP->getOptimalScore();
+    }
+
+    /*!
+     * \brief Compute the relaxed alignment with a sparse DP over the active alignment edges.
+     * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+     * \param mat The sequence score matrix, which provides the gap scores.
+     * \return The score of the relaxed alignment, which equals the score of the DP over the whole matrix.
+     */
+    ScoreType sparseRelaxedAlignment(TraceSegments & trace, SeqScoreMatrix const & mat)
+    {
+        // the edge indices are sorted by row and column
+        sparseMatches.clear();
+        for (size_t edgeIdx : edges.ids)
+        {
+            sparseMatches.emplace_back(edges.source(edgeIdx), edges.target(edgeIdx),
+                                       -priorityQ[edgeIdx].begin()->first);
+        }
+        return sparse.align(seqan::length(sequenceA), seqan::length(sequenceB), sparseMatches,
+                            mat.data_gap_open, mat.data_gap_extend, trace);
+    }
+
+    /*!
+     * \brief Compute a band for the relaxed DP, whose optimality is certified by the score of the banded DP.
+     * \param[out] lowerDiag The lower diagonal of the band, where the diagonal of a cell is posA - posB.
+     * \param[out] upperDiag The upper diagonal of the band.
+     * \param[out] certificate The banded DP is optimal for the whole matrix if its score is at least this value.
+     * \param target A lower bound for the score of the relaxed DP, e.g. the best valid solution.
+     * \param mat The sequence score matrix, which provides the gap scores.
+     * \return Whether the band is narrower than the matrix.
+     * \details
+     * The band spans the diagonals of the active edges and of both corners, widened by w on each side. A path
+     * between two matches can always be drawn inside the band, unless it contains a horizontal and a vertical gap
+     * of more than w each. The score of such a path is at most the sum of the best relaxed scores of each row (or
+     * column) plus two gap openings and 2w gap extensions. w is chosen such that this value is at most the target,
+     * which the banded DP reaches if it is optimal. The argument requires gap openings to be at least as expensive
+     * as gap extensions, otherwise no band is computed.
+     */
+    bool relaxedBand(int & lowerDiag, int & upperDiag, ScoreType & certificate, ScoreType target,
+                     SeqScoreMatrix const & mat)
+    {
+        int const lenA = static_cast<int>(seqan::length(sequenceA));
+        int const lenB = static_cast<int>(seqan::length(sequenceB));
+        if (target <= -infinity || mat.data_gap_extend >= 0 || mat.data_gap_open > mat.data_gap_extend)
+            return false;
+
+        // the envelope of the active edges and the best relaxed score in each row and column
+        int minDiag = std::min(0, lenA - lenB);
+        int maxDiag = std::max(0, lenA - lenB);
+        rowBest.assign(lenA, 0);
+        columnBest.assign(lenB, 0);
+        for (size_t edgeIdx : edges.ids)
+        {
+            int const posA = static_cast<int>(edges.source(edgeIdx));
+            int const posB = static_cast<int>(edges.target(edgeIdx));
+            minDiag = std::min(minDiag, posA - posB);
+            maxDiag = std::max(maxDiag, posA - posB);
+            ScoreType const relaxed = -priorityQ[edgeIdx].begin()->first;
+            rowBest[posA] = std::max(rowBest[posA], relaxed);
+            columnBest[posB] = std::max(columnBest[posB], relaxed);
+        }
+        int64_t const matchBound = std::min(std::accumulate(rowBest.begin(), rowBest.end(), int64_t{0}),
+                                            std::accumulate(columnBest.begin(), columnBest.end(), int64_t{0}));
+
+        // smallest w, such that matchBound + 2 * gap_open + 2 * w * gap_extend <= target
+        int64_t const excess = matchBound + 2 * mat.data_gap_open - target;
+        int64_t const extend2 = -2 * static_cast<int64_t>(mat.data_gap_extend);
+        int64_t const width = excess > 0 ? (excess + extend2 - 1) / extend2 : 0;
+        if (minDiag - width <= -lenB && maxDiag + width >= lenA)
+            return false;
+
+        lowerDiag = minDiag - static_cast<int>(width);
+        upperDiag = maxDiag + static_cast<int>(width);
+        certificate = static_cast<ScoreType>(matchBound + 2 * mat.data_gap_open - width * extend2);
+        return true;
+    }
+
+    //!\brief Return the relaxed score of aligning the given positions, or -infinity if there is no alignment edge.
+    ScoreType getRelaxedScore(size_t posA, size_t posB) const
+    {
+        size_t const edgeIdx = edges.index(posA, posB);
+        return edges.active[edgeIdx] ? -priorityQ[edgeIdx].begin()->first : -infinity;
+    }
+
     /*!
      * \brief Calculate the scores for the T-Coffee library.
      * \return A vector of triples of position, position and score.
@@ -447,7 +1165,7 @@ public:
 
         if (params.libraryScoreIsLinear)
         {
-            auto const mm = std::minmax_element(priorityQ.begin(), priorityQ.end(),
+            auto const mm = std::minmax_element(priorityQ.begin(), priorityQ.begin() + edges.size,
                 [] (PriorityQueue const & a, PriorityQueue const & b) { return a.begin()->first > b.begin()->first; });
             ScoreType const minScore = -(mm.first)->begin()->first;
             ScoreType const maxScore = -(mm.second)->begin()->first;
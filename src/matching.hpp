@@ -37,9 +37,13 @@
  * \brief This file contains the maximum weighted matching algorithms.
  */
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <iostream>
-#include <set>
+#include <memory>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
@@ -56,208 +60,587 @@
 namespace lara
 {
 
-typedef std::tuple<ScoreType, size_t, size_t> Interaction;    // probability, lineL, lineR
-typedef std::set<Interaction>::iterator InteractionIterator;
-typedef std::pair<InteractionIterator, InteractionIterator> EdgeConflict;
-typedef std::set<InteractionIterator> InteractionSet;
-
-} // namespace lara
-
-namespace std
-{
-
-template <>
-struct less<lara::InteractionIterator>
+class Matching
 {
-    bool operator()(const lara::InteractionIterator & lhs, const lara::InteractionIterator & rhs) const
+private:
+    //!\brief An interaction between two lines, which are given by their index in the current alignment.
+    struct Interaction
     {
-        return make_pair(get<1>(*lhs), get<2>(*lhs)) < make_pair(get<1>(*rhs), get<2>(*rhs));
-    }
-};
+        ScoreType key;  // the negative weight, such that the interactions are sorted by decreasing weight
+        uint32_t left;
+        uint32_t right;
 
-} // namespace std
+        bool operator<(Interaction const & other) const
+        {
+            return std::tie(key, left, right) < std::tie(other.key, other.left, other.right);
+        }
+    };
 
-namespace lara
-{
+    //!\brief The maximal lookahead of the greedy algorithm, which is limited by the size of the bit masks.
+    static constexpr size_t maxLookahead = 64ul;
 
-class Matching
-{
-private:
     std::unordered_map<size_t, size_t> contacts;
-    std::vector<std::vector<Contact>> const & possiblePartners;
-    size_t const algorithm;
+    std::vector<size_t> selfContacts; // LEMON reports the unmatched lines as contacts of themselves
+
+    // the interactions (line, partner, score) of the previous call and its result, which is reused if they are equal
+    std::vector<std::tuple<size_t, size_t, ScoreType>> interactions;
+    std::vector<std::tuple<size_t, size_t, ScoreType>> previousInteractions;
+    ScoreType previousScore;
+    int previousAlgorithm;
+    bool cached;
+
+#ifdef LEMON_FOUND
+    //!\brief The graph of the LEMON matching with its maps, which are kept for reuse.
+    struct LemonGraph
+    {
+        lemon::SmartGraph graph{};
+        lemon::SmartGraph::EdgeMap<ScoreType> weight{graph};
+        lemon::SmartGraph::EdgeMap<PosPair> lines{graph};
+        std::vector<lemon::SmartGraph::Node> nodes{}; // indexed like the current alignment
+    };
+
+    // the graph is not movable, therefore it is held by pointer and created on first use
+    std::unique_ptr<LemonGraph> lemonGraph;
+#endif
+
+    // buffers of the greedy algorithm
+    std::vector<Interaction> queue;
+    std::vector<bool> matched;
+    std::vector<PosPair> matchedLines;
+    std::array<Interaction, maxLookahead> selection;
+    std::array<uint64_t, maxLookahead> conflictMask;
+    size_t selectionSize;
+
+    // buffers of the non-crossing matching, the interval table is kept like the LEMON graph
+    std::vector<uint32_t> positions;
+    std::vector<size_t> firstInteraction;
+    std::vector<ScoreType> intervalTable;
+
+    // the automatic selection: calibrated nanoseconds per unit of the cost model of each algorithm, and the target
+    enum Engine
+    {
+        GREEDY,
+        NONCROSSING,
+        LEMON,
+        NUM_ENGINES
+    };
+    std::array<double, NUM_ENGINES> nsPerUnit;
+    double timeTarget;
+    std::vector<PosPair> greedyLines;
 
     //!\brief Helper function that calculates whether two interactions use the same vertex.
-    bool hasConflict(Interaction const & a, Interaction const & b)
+    static bool hasConflict(Interaction const & a, Interaction const & b)
     {
-        return std::get<1>(a) == std::get<1>(b)
-            || std::get<1>(a) == std::get<2>(b)
-            || std::get<2>(a) == std::get<1>(b)
-            || std::get<2>(a) == std::get<2>(b);
+        return a.left == b.left || a.left == b.right || a.right == b.left || a.right == b.right;
     }
 
-    InteractionSet solveConflicts(ScoreType & weight, std::vector<EdgeConflict> const & conflicts)
+    /*!
+     * \brief Find the first conflict between the selected interactions that are not eliminated.
+     * \param eliminated The bit mask of the eliminated interactions.
+     * \param[out] first The index of the first interaction of the conflict.
+     * \param[out] second The index of the second interaction of the conflict.
+     * \return Whether there is a conflict.
+     * \details The conflicts are ordered by the selection index of the first and then the second interaction.
+     */
+    bool firstConflict(uint64_t eliminated, size_t & first, size_t & second) const
     {
-        if (conflicts.empty())
-            return InteractionSet();
+        for (first = 0ul; first < selectionSize; ++first)
+        {
+            if (eliminated & (1ull << first))
+                continue;
 
-        auto edge_cmp = [] (InteractionIterator const & a, InteractionIterator const & b) { return (*a) >= (*b); };
-        InteractionIterator edgeS = std::min(conflicts.front().first, conflicts.front().second, edge_cmp);
-        InteractionIterator edgeL = std::max(conflicts.front().first, conflicts.front().second, edge_cmp);
-        ScoreType weightS = -std::get<0>(*edgeS);
-        ScoreType weightL = -std::get<0>(*edgeL);
+            uint64_t const later = conflictMask[first] & ~eliminated & (~1ull << first);
+            if (later != 0u)
+            {
+                second = lowestBit(later);
+                return true;
+            }
+        }
+        return false;
+    }
 
-        if (conflicts.size() == 1)
+    static size_t lowestBit(uint64_t mask)
+    {
+        size_t pos = 0ul;
+        while ((mask & 1u) == 0u)
+        {
+            mask >>= 1;
+            ++pos;
+        }
+        return pos;
+    }
+
+    /*!
+     * \brief Eliminate interactions with minimal weight, such that the remaining interactions have no conflict.
+     * \param[in,out] weight The weight of the eliminated interactions is added.
+     * \param eliminated The bit mask of the interactions that have been eliminated before.
+     * \return The bit mask of the newly eliminated interactions.
+     * \details
+     * The first conflict is resolved by eliminating one of its interactions, and the remaining conflicts are solved
+     * recursively. The lighter interaction is eliminated, unless eliminating the heavier one is cheaper in total.
+     */
+    uint64_t solveConflicts(ScoreType & weight, uint64_t eliminated) const
+    {
+        size_t first{};
+        size_t second{};
+        if (!firstConflict(eliminated, first, second))
+            return 0u;
+
+        // S is the interaction with the smaller weight, i.e. the greater key
+        bool const secondIsSmall = selection[first] < selection[second];
+        size_t const edgeS = secondIsSmall ? second : first;
+        size_t const edgeL = secondIsSmall ? first : second;
+        ScoreType weightS = -selection[edgeS].key;
+        ScoreType weightL = -selection[edgeL].key;
+
+        // whether S and L conflict only with each other, such that eliminating either leaves the same conflicts
+        bool const sameSubtree = (conflictMask[edgeS] & ~eliminated) == (1ull << edgeL) &&
+                                 (conflictMask[edgeL] & ~eliminated) == (1ull << edgeS);
+        if (sameSubtree && !firstConflict(eliminated | (1ull << edgeS), first, second))
         {
             weight += weightS;
-            return InteractionSet{edgeS};
+            return 1ull << edgeS;
         }
 
-        std::vector<EdgeConflict> remainingS;
-        std::copy_if(conflicts.begin(), conflicts.end(), std::back_inserter(remainingS),
-                     [&edgeS] (EdgeConflict const & c) {return edgeS != c.first && edgeS != c.second;});
-        InteractionSet eliminateS = solveConflicts(weightS, remainingS);
+        uint64_t const eliminateS = solveConflicts(weightS, eliminated | (1ull << edgeS));
 
-        if (weightS > weightL) // prune if S is already smaller
+        if (weightS > weightL && !sameSubtree) // prune if S is already smaller or L has the same subtree
         {
-            std::vector<EdgeConflict> remainingL;
-            std::copy_if(conflicts.begin(), conflicts.end(), std::back_inserter(remainingL),
-                         [&edgeL] (EdgeConflict const & c) {return edgeL != c.first && edgeL != c.second;});
-
-            if (remainingS != remainingL) // prune if L has the same subtree
+            uint64_t const eliminateL = solveConflicts(weightL, eliminated | (1ull << edgeL));
+            if (weightS > weightL)
             {
-                InteractionSet eliminateL = solveConflicts(weightL, remainingL);
-                if (weightS > weightL)
-                {
-                    eliminateL.insert(edgeL);
-                    weight += weightL;
-                    return eliminateL;
-                }
+                weight += weightL;
+                return eliminateL | (1ull << edgeL);
             }
         }
-        eliminateS.insert(edgeS);
         weight += weightS;
-        return eliminateS;
+        return eliminateS | (1ull << edgeS);
     }
 
     ScoreType computeGreedyMatching(std::vector<size_t> const & currentAlignment,
-                                size_t lookahead = 5ul)
+                                    std::vector<std::vector<Contact>> const & possiblePartners,
+                                    size_t lookahead = 5ul)
     {
-        // fill the priority queue with interaction edges
+        // fill the queue with the interaction edges, sorted by decreasing weight
         ScoreType score = 0;
-        std::set<Interaction> queue;
+        queue.clear();
         for (size_t idx = 0ul; idx < currentAlignment.size(); ++idx)
+        {
             for (Contact const & contact : possiblePartners[idx])
-                queue.emplace(-2 * contact.first, currentAlignment[idx], contact.second);
+            {
+                // the lines of the current alignment are sorted
+                auto const partner = std::lower_bound(currentAlignment.begin(), currentAlignment.end(),
+                                                      contact.second);
+                SEQAN_ASSERT(partner != currentAlignment.end() && *partner == contact.second);
+                queue.push_back({-2 * contact.first, static_cast<uint32_t>(idx),
+                                 static_cast<uint32_t>(partner - currentAlignment.begin())});
+            }
+        }
+        std::sort(queue.begin(), queue.end());
 
         if (lookahead > queue.size())
             lookahead = queue.size();
         else if (lookahead == 0)
             lookahead = 5;
+        lookahead = std::min(lookahead, maxLookahead);
 
         // select the best edges from queue
-        std::vector<InteractionIterator> selection{};
-        selection.reserve(lookahead);
-        contacts.clear();
+        matched.assign(currentAlignment.size(), false);
+        matchedLines.clear();
         auto queueIt = queue.begin();
         while (queueIt != queue.end())
         {
-            for (selection.clear(); selection.size() < lookahead && queueIt != queue.end(); ++queueIt)
-                if (contacts.count(std::get<1>(*queueIt)) == 0 && contacts.count(std::get<2>(*queueIt)) == 0)
-                    selection.push_back(queueIt);
+            for (selectionSize = 0ul; selectionSize < lookahead && queueIt != queue.end(); ++queueIt)
+                if (!matched[queueIt->left] && !matched[queueIt->right])
+                    selection[selectionSize++] = *queueIt;
 
             // search conflicts
-            std::vector<EdgeConflict> conflicts{};
-            for (auto itA = selection.begin(); itA != selection.end(); ++itA)
-                for (auto itB = itA + 1; itB != selection.end(); ++itB)
-                    if (hasConflict(**itA, **itB))
-                        conflicts.emplace_back(*itA, *itB);
+            for (size_t idxA = 0ul; idxA < selectionSize; ++idxA)
+                conflictMask[idxA] = 0u;
+            for (size_t idxA = 0ul; idxA < selectionSize; ++idxA)
+            {
+                for (size_t idxB = idxA + 1ul; idxB < selectionSize; ++idxB)
+                {
+                    if (hasConflict(selection[idxA], selection[idxB]))
+                    {
+                        conflictMask[idxA] |= 1ull << idxB;
+                        conflictMask[idxB] |= 1ull << idxA;
+                    }
+                }
+            }
 
             // solve conflicts
             ScoreType weight = 0;
-            InteractionSet eliminate = solveConflicts(weight, conflicts);
+            uint64_t const eliminate = solveConflicts(weight, 0u);
 
             // save MWM contacts and count score
-            for (InteractionIterator const & it : selection)
+            for (size_t idx = 0ul; idx < selectionSize; ++idx)
             {
-                if (eliminate.count(it) == 0)
+                if ((eliminate & (1ull << idx)) == 0u)
                 {
-                    contacts[std::get<1>(*it)] = std::get<2>(*it);
-                    contacts[std::get<2>(*it)] = std::get<1>(*it);
-                    score += -std::get<0>(*it);
+                    Interaction const & inter = selection[idx];
+                    matched[inter.left] = true;
+                    matched[inter.right] = true;
+                    matchedLines.emplace_back(currentAlignment[inter.left], currentAlignment[inter.right]);
+                    score += -inter.key;
                 }
             }
         }
         return score;
     }
 
-#ifdef LEMON_FOUND
     /*!
-     * \brief Computes a maximum weighted matching using LEMON.
-     * \param[out] contacts         The pairing result of the matching.
-     * \param[in]  currentAlignment The active lines, which build the alignment.
+     * \brief Computes a maximum weighted non-crossing matching with a Nussinov-style interval DP.
+     * \param currentAlignment The active lines, which build the alignment, in increasing order.
+     * \param possiblePartners The interactions of each line with the following lines.
      * \returns The score of the matching.
+     * \details
+     * Only the lines with interactions take part in the DP. The score of an interval is the maximum of leaving its
+     * first line unpaired and pairing it with a partner in the interval, which splits the interval in two.
      */
-    ScoreType computeLemonMatching(std::vector<size_t> const & currentAlignment)
+    ScoreType computeNonCrossingMatching(std::vector<size_t> const & currentAlignment,
+                                         std::vector<std::vector<Contact>> const & possiblePartners)
     {
-        contacts.clear();
+        matchedLines.clear();
 
-        lemon::SmartGraph lemonG;
-        std::unordered_map<size_t, lemon::SmartGraph::Node> nodes{};
+        // collect the interactions with the indices of the lines
+        queue.clear();
+        for (size_t idx = 0ul; idx < currentAlignment.size(); ++idx)
+        {
+            for (Contact const & contact : possiblePartners[idx])
+            {
+                auto const partner = std::lower_bound(currentAlignment.begin(), currentAlignment.end(),
+                                                      contact.second);
+                SEQAN_ASSERT(partner != currentAlignment.end() && *partner == contact.second);
+                queue.push_back({-2 * contact.first, static_cast<uint32_t>(idx),
+                                 static_cast<uint32_t>(partner - currentAlignment.begin())});
+            }
+        }
+        if (queue.empty())
+            return 0;
+
+        // compress the lines with interactions to consecutive positions
+        positions.clear();
+        for (Interaction const & inter : queue)
+        {
+            positions.push_back(inter.left);
+            positions.push_back(inter.right);
+        }
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+        size_t const len = positions.size();
+        auto compressed = [this] (uint32_t line)
+        {
+            return static_cast<uint32_t>(std::lower_bound(positions.begin(), positions.end(), line) -
+                                         positions.begin());
+        };
+        for (Interaction & inter : queue)
+        {
+            inter.left = compressed(inter.left);
+            inter.right = compressed(inter.right);
+            if (inter.left > inter.right)
+                std::swap(inter.left, inter.right);
+        }
+
+        // the interactions sorted by their left position, with an index to the first one of each position
+        std::sort(queue.begin(), queue.end(), [] (Interaction const & lhs, Interaction const & rhs)
+        {
+            return std::tie(lhs.left, lhs.right) < std::tie(rhs.left, rhs.right);
+        });
+        firstInteraction.assign(len + 1ul, queue.size());
+        for (size_t idx = queue.size(); idx > 0ul; --idx)
+            firstInteraction[queue[idx - 1ul].left] = idx - 1ul;
+
+        // interval scores: intervalTable[i * (len + 1) + j] is the score of the positions [i, j)
+        intervalTable.assign((len + 1ul) * (len + 1ul), 0);
+        auto get = [this, len] (size_t begin, size_t end) -> ScoreType &
+        {
+            return intervalTable[(len + 1ul) * begin + end];
+        };
 
-        for (size_t const & line : currentAlignment)
+        for (size_t begin = len; begin > 0ul; --begin)
         {
-            contacts[line] = line;
-            nodes[line] = lemonG.addNode();
+            size_t const first = begin - 1ul;
+            for (size_t end = begin; end <= len; ++end)
+            {
+                ScoreType best = get(begin, end); // first position unpaired
+                for (size_t idx = firstInteraction[first]; idx < queue.size() && queue[idx].left == first; ++idx)
+                {
+                    size_t const partner = queue[idx].right;
+                    if (partner >= end)
+                        break;
+                    best = std::max(best, -queue[idx].key + get(begin, partner) + get(partner + 1ul, end));
+                }
+                get(first, end) = best;
+            }
         }
 
-        typedef lemon::SmartGraph::EdgeMap<ScoreType> EdgeMap;
-        EdgeMap weight(lemonG);
-        lemon::SmartGraph::EdgeMap<PosPair> interactions(lemonG);
+        // trace back the pairs
+        std::vector<PosPair> intervals{{0ul, len}};
+        while (!intervals.empty())
+        {
+            PosPair const interval = intervals.back();
+            intervals.pop_back();
+            if (interval.first >= interval.second)
+                continue;
+
+            size_t const first = interval.first;
+            if (get(first, interval.second) == get(first + 1ul, interval.second))
+            {
+                intervals.emplace_back(first + 1ul, interval.second);
+                continue;
+            }
+
+            for (size_t idx = firstInteraction[first]; idx < queue.size() && queue[idx].left == first; ++idx)
+            {
+                size_t const partner = queue[idx].right;
+                if (partner < interval.second &&
+                    get(first, interval.second) ==
+                        -queue[idx].key + get(first + 1ul, partner) + get(partner + 1ul, interval.second))
+                {
+                    matchedLines.emplace_back(currentAlignment[positions[first]], currentAlignment[positions[partner]]);
+                    intervals.emplace_back(first + 1ul, partner);
+                    intervals.emplace_back(partner + 1ul, interval.second);
+                    break;
+                }
+            }
+        }
+        return get(0ul, len);
+    }
+
+    //!\brief The cost model of the matching algorithms in units, which are calibrated to nanoseconds.
+    static double predictedUnits(Engine engine, double numLines, double numInteractions, double lookahead)
+    {
+        switch (engine)
+        {
+            case GREEDY:      return numInteractions * (std::log2(numInteractions + 1.0) + lookahead);
+            case NONCROSSING: return numLines * (numLines + numInteractions);
+            default:          return numLines * numInteractions * std::log2(numLines + 2.0);
+        }
+    }
+
+    //!\brief Run a matching algorithm and update the calibration of its cost model with the measured time.
+    template <typename TRun>
+    ScoreType runCalibrated(Engine engine, double units, TRun && run, double & elapsed)
+    {
+        Clock::time_point const start = Clock::now();
+        ScoreType const score = run();
+        elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        nsPerUnit[engine] = 0.8 * nsPerUnit[engine] + 0.2 * elapsed / std::max(units, 1.0);
+        return score;
+    }
+
+    /*!
+     * \brief Select the matching algorithm with the best quality whose predicted running time meets the target.
+     * \param currentAlignment The active lines, which build the alignment, in increasing order.
+     * \param possiblePartners The interactions of each line with the following lines.
+     * \returns The score of the matching.
+     * \details
+     * The prediction is based on the numbers of interactions and of lines with interactions. LEMON is exact and
+     * preferred if it fits. Otherwise the greedy algorithm runs with the largest lookahead that fits, and the interval
+     * DP runs as well if the remaining time allows it. The DP is optimal among the non-crossing matchings only, so
+     * neither result bounds the other, and the better one is kept.
+     * The greedy algorithm always runs, even if the target is missed. The calibration of an algorithm that is
+     * skipped decays slowly, such that an overestimated algorithm is tried again after a while.
+     */
+    ScoreType computeAutoMatching(std::vector<size_t> const & currentAlignment,
+                                  std::vector<std::vector<Contact>> const & possiblePartners)
+    {
+        double const numInteractions = static_cast<double>(interactions.size());
+        double const numLines = static_cast<double>(std::min(currentAlignment.size(), 2ul * interactions.size()));
+        double budget = timeTarget;
+        double elapsed{};
+
+#ifdef LEMON_FOUND
+        double const lemonUnits = predictedUnits(LEMON, numLines, numInteractions, 0.0);
+        if (nsPerUnit[LEMON] * lemonUnits <= budget)
+        {
+            return runCalibrated(LEMON, lemonUnits,
+                                 [&] () { return computeLemonMatching(currentAlignment, possiblePartners); },
+                                 elapsed);
+        }
+        nsPerUnit[LEMON] *= 0.99;
+#endif
+
+        size_t lookahead = 1ul;
+        size_t const widest = maxLookahead;
+        for (size_t candidate : {widest, 16ul, 5ul})
+        {
+            if (nsPerUnit[GREEDY] * predictedUnits(GREEDY, numLines, numInteractions, candidate) <= budget)
+            {
+                lookahead = candidate;
+                break;
+            }
+        }
+        ScoreType const greedyScore =
+            runCalibrated(GREEDY, predictedUnits(GREEDY, numLines, numInteractions, lookahead),
+                          [&] () { return computeGreedyMatching(currentAlignment, possiblePartners, lookahead); },
+                          elapsed);
+        budget -= elapsed;
+
+        double const noncrossingUnits = predictedUnits(NONCROSSING, numLines, numInteractions, 0.0);
+        if (nsPerUnit[NONCROSSING] * noncrossingUnits > budget)
+        {
+            nsPerUnit[NONCROSSING] *= 0.99;
+            return greedyScore;
+        }
+
+        std::swap(matchedLines, greedyLines);
+        ScoreType const noncrossingScore =
+            runCalibrated(NONCROSSING, noncrossingUnits,
+                          [&] () { return computeNonCrossingMatching(currentAlignment, possiblePartners); },
+                          elapsed);
+        if (noncrossingScore >= greedyScore)
+            return noncrossingScore;
+
+        std::swap(matchedLines, greedyLines);
+        return greedyScore;
+    }
+
+#ifdef LEMON_FOUND
+    /*!
+     * \brief Computes a maximum weighted matching using LEMON.
+     * \param currentAlignment The active lines, which build the alignment.
+     * \param possiblePartners The interactions of each line with the following lines.
+     * \returns The score of the matching.
+     */
+    ScoreType computeLemonMatching(std::vector<size_t> const & currentAlignment,
+                                   std::vector<std::vector<Contact>> const & possiblePartners)
+    {
+        matchedLines.clear();
+        if (!lemonGraph)
+            lemonGraph.reset(new LemonGraph());
+
+        // clearing the graph also clears the maps that are attached to it, but keeps their memory
+        LemonGraph & lg = *lemonGraph;
+        lg.graph.clear();
+        lg.graph.reserveNode(static_cast<int>(currentAlignment.size()));
+        lg.graph.reserveEdge(static_cast<int>(interactions.size()));
+
+        lg.nodes.clear();
+        for (size_t idx = 0ul; idx < currentAlignment.size(); ++idx)
+            lg.nodes.push_back(lg.graph.addNode());
+
         for (size_t idx = 0ul; idx < currentAlignment.size(); ++idx)
         {
             for (Contact const & contact : possiblePartners[idx])
             {
-                auto newEdge = lemonG.addEdge(nodes[currentAlignment[idx]], nodes[contact.second]);
-                weight[newEdge] = 2 * contact.first;
-                interactions[newEdge] = std::make_pair(currentAlignment[idx], contact.second);
+                // the lines of the current alignment are sorted
+                auto const partner = std::lower_bound(currentAlignment.begin(), currentAlignment.end(),
+                                                      contact.second);
+                SEQAN_ASSERT(partner != currentAlignment.end() && *partner == contact.second);
+                auto newEdge = lg.graph.addEdge(lg.nodes[idx], lg.nodes[partner - currentAlignment.begin()]);
+                lg.weight[newEdge] = 2 * contact.first;
+                lg.lines[newEdge] = std::make_pair(currentAlignment[idx], contact.second);
             }
         }
-        lemon::MaxWeightedMatching<lemon::SmartGraph, EdgeMap> mwm(lemonG, weight);
+        lemon::MaxWeightedMatching<lemon::SmartGraph, lemon::SmartGraph::EdgeMap<ScoreType>> mwm(lg.graph, lg.weight);
         mwm.run();
-        for (lemon::SmartGraph::EdgeIt edgeIt(lemonG); edgeIt!=lemon::INVALID; ++edgeIt)
+        for (lemon::SmartGraph::EdgeIt edgeIt(lg.graph); edgeIt != lemon::INVALID; ++edgeIt)
         {
-            PosPair inter = interactions[edgeIt];
             if (mwm.matching(edgeIt))
-            {
-                contacts[inter.first] = inter.second;
-                contacts[inter.second] = inter.first;
-            }
+                matchedLines.push_back(lg.lines[edgeIt]);
         }
         return mwm.matchingWeight();
     }
 #endif
 
 public:
-    explicit Matching(std::vector<std::vector<Contact>> const & possiblePartners_, size_t algorithm_) :
+    Matching() :
         contacts(),
-        possiblePartners(possiblePartners_),
-        algorithm(algorithm_)
+        selfContacts(),
+        interactions(),
+        previousInteractions(),
+        previousScore{0},
+        previousAlgorithm{0},
+        cached{false},
+#ifdef LEMON_FOUND
+        lemonGraph(),
+#endif
+        queue(),
+        matched(),
+        matchedLines(),
+        selection{},
+        conflictMask{},
+        selectionSize{0ul},
+        positions(),
+        firstInteraction(),
+        intervalTable(),
+        nsPerUnit{{2.0, 1.0, 10.0}},
+        timeTarget{2e5},
+        greedyLines()
     {}
 
+    //!\brief Set the time target of the automatic selection in microseconds.
+    void setTimeTarget(UnsignedType microseconds)
+    {
+        timeTarget = 1e3 * microseconds;
+    }
+
     std::unordered_map<size_t, size_t> getContacts()
     {
+        // the matched lines are only converted on demand
+        if (contacts.empty())
+        {
+            for (size_t line : selfContacts)
+                contacts[line] = line;
+            for (PosPair const & lines : matchedLines)
+            {
+                contacts[lines.first] = lines.second;
+                contacts[lines.second] = lines.first;
+            }
+        }
         return contacts;
     }
 
-    ScoreType computeScore(std::vector<size_t> const & currentAlignment)
+    /*!
+     * \brief Compute a maximum weighted matching of the interactions between the given lines.
+     * \param currentAlignment The active lines, which build the alignment, in increasing order.
+     * \param possiblePartners The interactions of each line with the following lines.
+     * \param algorithm The matching algorithm: greedy with the given lookahead (> 0), LEMON (0), DP (-1) or the
+     *                  automatic selection (-2).
+     * \returns The score of the matching.
+     * \details
+     * The matching depends only on the interactions, because lines without interactions stay unmatched and the
+     * algorithms break ties by the order of the lines. Hence the previous result is reused if the interactions and
+     * the algorithm are unchanged, which is common late in the subgradient optimisation.
+     */
+    ScoreType computeScore(std::vector<size_t> const & currentAlignment,
+                           std::vector<std::vector<Contact>> const & possiblePartners,
+                           int algorithm)
     {
+        interactions.clear();
+        for (size_t idx = 0ul; idx < currentAlignment.size(); ++idx)
+            for (Contact const & contact : possiblePartners[idx])
+                interactions.emplace_back(currentAlignment[idx], contact.second, contact.first);
+
+        contacts.clear();
+        selfContacts.clear();
 #ifdef LEMON_FOUND
         if (algorithm == 0)
-            return computeLemonMatching(currentAlignment);
-        else
+            selfContacts = currentAlignment;
 #endif
-            return computeGreedyMatching(currentAlignment, algorithm);
+        if (cached && algorithm == previousAlgorithm && interactions == previousInteractions)
+        {
+            _LOG(3, "     reuse the previous matching" << std::endl);
+            return previousScore;
+        }
+
+        if (algorithm < -1)
+            previousScore = computeAutoMatching(currentAlignment, possiblePartners);
+        else if (algorithm < 0)
+            previousScore = computeNonCrossingMatching(currentAlignment, possiblePartners);
+#ifdef LEMON_FOUND
+        else if (algorithm == 0)
+            previousScore = computeLemonMatching(currentAlignment, possiblePartners);
+#endif
+        else
+            previousScore = computeGreedyMatching(currentAlignment, possiblePartners, static_cast<size_t>(algorithm));
+
+        std::swap(interactions, previousInteractions);
+        previousAlgorithm = algorithm;
+        cached = true;
+        return previousScore;
     }
 };
 
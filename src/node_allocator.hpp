@@ -0,0 +1,185 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+#pragma once
+
+/*!\file node_allocator.hpp
+ * \brief This file contains an allocator that recycles the nodes of node-based containers.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lara
+{
+
+/*!
+ * \brief A pool of freed nodes, with one free list for each node size.
+ * \details
+ * The pool belongs to the object that owns the containers, so the nodes are reused no matter which thread clears
+ * and which thread refills the containers. It is not synchronised, i.e. only one thread may use it at a time.
+ * Memory is handed back when the pool is destroyed.
+ */
+class NodePool
+{
+private:
+    struct FreeNode
+    {
+        FreeNode * next;
+    };
+
+    std::vector<std::pair<std::size_t, FreeNode *>> freeLists; // block size and head of the list
+
+    FreeNode *& head(std::size_t blockSize)
+    {
+        for (std::pair<std::size_t, FreeNode *> & list : freeLists)
+            if (list.first == blockSize)
+                return list.second;
+        freeLists.emplace_back(blockSize, nullptr);
+        return freeLists.back().second;
+    }
+
+public:
+    NodePool() = default;
+    NodePool(NodePool const &) = delete;
+    NodePool & operator=(NodePool const &) = delete;
+
+    ~NodePool()
+    {
+        for (std::pair<std::size_t, FreeNode *> & list : freeLists)
+        {
+            while (list.second != nullptr)
+            {
+                FreeNode * node = list.second;
+                list.second = node->next;
+                ::operator delete(node);
+            }
+        }
+    }
+
+    void * allocate(std::size_t bytes)
+    {
+        std::size_t const blockSize = std::max(bytes, sizeof(FreeNode));
+        FreeNode *& list = head(blockSize);
+        if (list == nullptr)
+            return ::operator new(blockSize);
+
+        FreeNode * node = list;
+        list = node->next;
+        return node;
+    }
+
+    void deallocate(void * ptr, std::size_t bytes) noexcept
+    {
+        std::size_t const blockSize = std::max(bytes, sizeof(FreeNode));
+        for (std::pair<std::size_t, FreeNode *> & list : freeLists)
+        {
+            if (list.first == blockSize)
+            {
+                FreeNode * node = static_cast<FreeNode *>(ptr);
+                node->next = list.second;
+                list.second = node;
+                return;
+            }
+        }
+        ::operator delete(ptr); // not reached, the block has been allocated from this pool
+    }
+};
+
+/*!
+ * \brief Allocator for node-based containers (std::set, std::unordered_map) that keeps freed nodes in a NodePool.
+ * \details
+ * Single nodes are taken from and returned to the pool, so that a container, which is cleared and refilled for the
+ * next alignment, does not cause traffic on the global allocator. The pool moves along with the containers, e.g.
+ * when a solver is prepared on one thread and recycled on another. Requests for more than one element (e.g. bucket
+ * arrays) and allocators without a pool are forwarded to the global allocator.
+ */
+template <typename TValue>
+class NodeAllocator
+{
+private:
+    template <typename TOther>
+    friend class NodeAllocator;
+
+    std::shared_ptr<NodePool> pool;
+
+public:
+    typedef TValue value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    NodeAllocator() noexcept = default;
+
+    explicit NodeAllocator(std::shared_ptr<NodePool> nodePool) noexcept : pool(std::move(nodePool)) {}
+
+    template <typename TOther>
+    NodeAllocator(NodeAllocator<TOther> const & other) noexcept : pool(other.pool) {}
+
+    TValue * allocate(std::size_t num)
+    {
+        if (num != 1ul || !pool)
+            return static_cast<TValue *>(::operator new(num * sizeof(TValue)));
+        return static_cast<TValue *>(pool->allocate(sizeof(TValue)));
+    }
+
+    void deallocate(TValue * ptr, std::size_t num) noexcept
+    {
+        if (num != 1ul || !pool)
+            ::operator delete(ptr);
+        else
+            pool->deallocate(ptr, sizeof(TValue));
+    }
+
+    template <typename TValueA, typename TValueB>
+    friend bool operator==(NodeAllocator<TValueA> const & lhs, NodeAllocator<TValueB> const & rhs) noexcept;
+};
+
+template <typename TValueA, typename TValueB>
+inline bool operator==(NodeAllocator<TValueA> const & lhs, NodeAllocator<TValueB> const & rhs) noexcept
+{
+    return lhs.pool == rhs.pool;
+}
+
+template <typename TValueA, typename TValueB>
+inline bool operator!=(NodeAllocator<TValueA> const & lhs, NodeAllocator<TValueB> const & rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+} // namespace lara
@@ -61,9 +61,11 @@ public:
         CONTINUE   = 2
     };
     Status status{};
+    Clock::time_point        timeStart{Clock::now()}; // program start, from which the time limit is measured
 
     // GENERAL OPTIONS
     unsigned                 threads{};
+    UnsignedType             pipelineMemory{};       // max megabytes of the solvers that are prepared in advance
 
     // INPUT OPTIONS
     std::string              inFile{};               // Name of input file
@@ -81,9 +83,21 @@ public:
     UnsignedType             numIterations{};        // number of iterations
     UnsignedType             maxNondecrIterations{}; // number of non-decreasing iterations
     float                    stepSizeFactor{};       // my, necessary for computing appropriate step sizes
+    UnsignedType             stepSizeStrategy{};     // step size strategy: HALVING, POLYAK, DEFLECTED or BUNDLE
     float                    epsilon{};              // max distance that means equality of upper and lower bound
-    UnsignedType             matching{};             // select matching algorithm
+    float                    relativeGap{};          // max distance relative to the upper bound that means equality
+    UnsignedType             stableRounds{};         // stop if the best solution is unchanged for this many iterations
+    float                    stableGap{};            // ... and the relative gap is at most this value
+    int                      matching{};             // matching algorithm: lookahead, LEMON (0), DP (-1), auto (-2)
+    UnsignedType             matchingTime{};         // time target in microseconds for the automatic matching selection
     float                    suboptimalDiff{};       // Gap open and extend costs for generating the alignment edges
+    bool                     warmStart{};            // initialise the duals from previously converged alignments
+    UnsignedType             pruneInterval{};        // number of iterations between the removal of suboptimal edges
+    UnsignedType             bnbNodes{};             // number of branch and bound nodes for alignments with a gap
+    float                    sparseDensity{};        // use the sparse DP below this fraction of active edges
+    bool                     incrementalDP{};        // keep the DP matrix and recompute only the changed rows
+    UnsignedType             incrementalMemory{};    // max megabytes of the kept DP matrices of an alignment
+    UnsignedType             timeLimit{};            // wall-clock limit in seconds for solving the alignments
 
     // SCORING OPTIONS
     float                    balance{};              // how much the sequence identity influences sequenceScale
@@ -128,6 +142,14 @@ private:
         setMinValue(parser, "j", "0");
         setDefaultValue(parser, "j", "1");
 
+        addOption(parser, ArgParseOption("", "pipelinemem",
+                                         "Maximal memory in MB of the solvers that a helper thread prepares for the "
+                                         "next alignments. The helper counts as one of the threads and runs only "
+                                         "if there are more alignments than fit into the vector lanes of the others.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "pipelinemem", "1");
+        setDefaultValue(parser, "pipelinemem", "512");
+
         // Input options
         addSection(parser, "Input Options");
 
@@ -182,17 +204,61 @@ private:
                                          ArgParseArgument::DOUBLE, "FLOAT"));
         setDefaultValue(parser, "f", "1.0");
 
+        addOption(parser, ArgParseOption("", "stepsize",
+                                         "The step size strategy, either HALVING (0) the factor after non-improving "
+                                         "iterations, POLYAK (1) with an adaptive target value, DEFLECTED (2) "
+                                         "subgradients that include the previous direction, or BUNDLE (3) steps "
+                                         "from the best point so far along an aggregate of the subgradients.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "stepsize", "0");
+        setMaxValue(parser, "stepsize", "3");
+        setDefaultValue(parser, "stepsize", "0");
+
         addOption(parser, ArgParseOption("e", "epsilon",
                                          "Maximal distance that means equality of upper and lower bound.",
                                          ArgParseArgument::DOUBLE, "FLOAT"));
         setDefaultValue(parser, "e", "0.01");
 
+        addOption(parser, ArgParseOption("", "relgap",
+                                         "Maximal distance of upper and lower bound relative to the upper bound "
+                                         "that means equality. Value 0 disables the relative criterion.",
+                                         ArgParseArgument::DOUBLE, "FLOAT"));
+        setMinValue(parser, "relgap", "0.0");
+        setDefaultValue(parser, "relgap", "0.0");
+
+        addOption(parser, ArgParseOption("", "stable",
+                                         "Stop if the best alignment and its matching have not changed for INT "
+                                         "iterations and the relative gap is at most stablegap. Value 0 disables "
+                                         "the criterion.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "stable", "0");
+        setDefaultValue(parser, "stable", "0");
+
+        addOption(parser, ArgParseOption("", "stablegap",
+                                         "Maximal distance of upper and lower bound relative to the upper bound "
+                                         "for the stable criterion.",
+                                         ArgParseArgument::DOUBLE, "FLOAT"));
+        setMinValue(parser, "stablegap", "0.0");
+        setDefaultValue(parser, "stablegap", "0.01");
+
         addOption(parser, ArgParseOption("m", "matching",
-                                         "Lookahead for greedy matching algorithm. Value 0 uses LEMON instead.",
+                                         "Lookahead for greedy matching algorithm, at most 64. Value 0 uses LEMON "
+                                         "instead. Value -1 computes an exact non-crossing matching by dynamic "
+                                         "programming. "
+                                         "Value -2 selects the algorithm for each matching, see --matchtime.",
                                          ArgParseArgument::INTEGER, "INT"));
-        setMinValue(parser, "m", "0");
+        setMinValue(parser, "m", "-2");
+        setMaxValue(parser, "m", "64"); // the bit masks of the greedy matching hold 64 interactions
         setDefaultValue(parser, "m", "5");
 
+        addOption(parser, ArgParseOption("", "matchtime",
+                                         "Time target in microseconds for a single matching with --matching -2. The "
+                                         "algorithm with the best quality, whose predicted running time meets the "
+                                         "target, is selected. The predictions are calibrated during the run.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "matchtime", "1");
+        setDefaultValue(parser, "matchtime", "200");
+
         addOption(parser, ArgParseOption("u", "subopt",
                                          "Parameter for filtering alignment edges. Only those are created, whose prefix"
                                          " score + suffix score in the DP matrix is at most subopt below the "
@@ -200,6 +266,59 @@ private:
                                          ArgParseArgument::DOUBLE, "FLOAT"));
         setDefaultValue(parser, "u", "40.0");
 
+        addOption(parser, ArgParseOption("", "prune",
+                                         "Every INT iterations, remove the alignment edges whose best relaxed score "
+                                         "is below the best solution found so far. Value 0 disables the pruning.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "prune", "0");
+        setDefaultValue(parser, "prune", "0");
+
+        addOption(parser, ArgParseOption("", "bnb",
+                                         "If the bounds of an alignment differ after the last iteration, try to close "
+                                         "the gap with a branch and bound on the interactions that evaluates at most "
+                                         "INT nodes. Value 0 disables the branch and bound.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "bnb", "0");
+        setDefaultValue(parser, "bnb", "0");
+
+        addOption(parser, ArgParseOption("", "sparse",
+                                         "Compute the relaxed alignment with a sparse DP over the alignment edges, if "
+                                         "their number is below FLOAT times the size of the DP matrix. The sparse DP "
+                                         "is exact and its running time depends on the number of edges only. "
+                                         "Value 0 disables the sparse DP.",
+                                         ArgParseArgument::DOUBLE, "FLOAT"));
+        setMinValue(parser, "sparse", "0.0");
+        setMaxValue(parser, "sparse", "1.0");
+        setDefaultValue(parser, "sparse", "0.0");
+
+        addOption(parser, ArgParseOption("", "incremental",
+                                         "Keep the DP matrix of each alignment and recompute only the rows from the "
+                                         "first changed score on, skipping rows whose result did not change. Needs "
+                                         "memory for three matrices per alignment, see --incrementalmem. Not "
+                                         "supported by the SIMD solver."));
+
+        addOption(parser, ArgParseOption("", "incrementalmem",
+                                         "Maximal memory in MB for the matrices of the incremental DP of an "
+                                         "alignment. Larger alignments use the regular DP.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "incrementalmem", "1");
+        setDefaultValue(parser, "incrementalmem", "256");
+
+        addOption(parser, ArgParseOption("", "timelimit",
+                                         "Time limit in seconds for solving the structural alignments. The number "
+                                         "of iterations per alignment is reduced as the limit approaches. At the "
+                                         "limit, the best alignments found so far are written, and the alignments "
+                                         "that have not been started are computed from the sequences only. The "
+                                         "limit is measured from the program start, but these sequence alignments "
+                                         "and writing the output may exceed it. Value 0 disables the limit.",
+                                         ArgParseArgument::INTEGER, "INT"));
+        setMinValue(parser, "timelimit", "0");
+        setDefaultValue(parser, "timelimit", "0");
+
+        addOption(parser, ArgParseOption("", "warmstart",
+                                         "Initialise the dual variables with the values of previously converged "
+                                         "alignments that share a sequence."));
+
 
         // Scoring options
         addSection(parser, "Scoring Options");
@@ -248,6 +367,7 @@ private:
         // GENERAL OPTIONS
         getOptionValue(verbose_level, parser, "verbose");
         getOptionValue(threads, parser, "threads");
+        getOptionValue(pipelineMemory, parser, "pipelinemem");
         if (threads == 0u)
         {
             unsigned nthreads = std::thread::hardware_concurrency();
@@ -284,9 +404,28 @@ private:
         getOptionValue(numIterations, parser, "numiter");
         getOptionValue(maxNondecrIterations, parser, "maxnondecreasing");
         getOptionValue(stepSizeFactor, parser, "factor");
+        getOptionValue(stepSizeStrategy, parser, "stepsize");
         getOptionValue(epsilon, parser, "epsilon");
+        getOptionValue(relativeGap, parser, "relgap");
+        getOptionValue(stableRounds, parser, "stable");
+        getOptionValue(stableGap, parser, "stablegap");
         getOptionValue(matching, parser, "matching");
+        getOptionValue(matchingTime, parser, "matchtime");
         getOptionValue(suboptimalDiff, parser, "subopt");
+        warmStart = isSet(parser, "warmstart");
+        getOptionValue(pruneInterval, parser, "prune");
+        getOptionValue(bnbNodes, parser, "bnb");
+        getOptionValue(sparseDensity, parser, "sparse");
+        incrementalDP = isSet(parser, "incremental");
+        getOptionValue(incrementalMemory, parser, "incrementalmem");
+#ifdef SEQAN_SIMD_ENABLED
+        if (incrementalDP)
+        {
+            std::cerr << "Error: The incremental DP is not supported by the SIMD solver." << std::endl;
+            return EXIT_ERROR;
+        }
+#endif
+        getOptionValue(timeLimit, parser, "timelimit");
 
         // SCORING OPTIONS
         seqan::Score<float, seqan::ScoreMatrix<seqan::Rna5>> mat;
@@ -0,0 +1,362 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+
+#pragma once
+
+/*!\file portfolio.hpp
+ * \brief This file contains the portfolio solving of few pairs of sequences with differently configured solvers.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "data_types.hpp"
+#include "edge_filter.hpp"
+#include "io.hpp"
+#include "lagrange.hpp"
+#include "parameters.hpp"
+#include "step_size.hpp"
+#include "time_budget.hpp"
+
+namespace lara
+{
+
+/*!
+ * \brief The state that the portfolio members share for the same pair of sequences.
+ * \details
+ * Every lower bound is the score of a valid solution and every upper bound is the optimum of a relaxation of the
+ * same problem. Therefore the best bounds of any member are valid for all members of the pair. The aligned columns
+ * of the best valid solution are kept with the lower bound, which never exceeds their score.
+ */
+struct PortfolioPair
+{
+    PosPair sequenceIndices{};
+    std::atomic<ScoreType> bestLower{-infinity};
+    std::atomic<ScoreType> bestUpper{infinity};
+    std::atomic<bool> finished{false};
+
+    std::mutex mutex;                   // guards the best solution
+    WeightedAlignedColumns bestLines{}; // the aligned columns of the best valid solution
+    ScoreType bestLinesScore{-infinity};
+};
+
+//!\brief Raise the shared value to the given value, if it is larger.
+inline void atomicMax(std::atomic<ScoreType> & shared, ScoreType value)
+{
+    ScoreType current = shared.load();
+    while (value > current && !shared.compare_exchange_weak(current, value)) {}
+}
+
+//!\brief Lower the shared value to the given value, if it is smaller.
+inline void atomicMin(std::atomic<ScoreType> & shared, ScoreType value)
+{
+    ScoreType current = shared.load();
+    while (value < current && !shared.compare_exchange_weak(current, value)) {}
+}
+
+/*!
+ * \brief Derive the configuration of a portfolio member from the parameters.
+ * \param params The parameters given by the user, which are used unchanged for variant 0.
+ * \param variant The number of the member within its pair.
+ * \return The parameters with a different step size strategy, step size factor and matching lookahead.
+ */
+inline Parameters portfolioVariant(Parameters const & params, size_t variant)
+{
+    float const factors[3] = {1.0f, 0.5f, 2.0f};
+    Parameters result(params);
+    result.stepSizeStrategy = (params.stepSizeStrategy + variant) % 4u;
+    result.stepSizeFactor = params.stepSizeFactor * factors[(variant / 8u) % 3u];
+    if ((variant / 4u) % 2u == 1u && params.matching > 0)
+        result.matching = std::min(2 * params.matching, 64); // the maximal lookahead, see --matching
+    return result;
+}
+
+/*!
+ * \brief A subgradient solver for one pair of sequences that exchanges its bounds with the other members.
+ * \details
+ * The member is not bound to a score matrix. It runs the relaxed alignment directly on the scores of its Lagrange
+ * object, so that any number of members can work on the same pair independently of the SIMD layout. Like in the
+ * solvers, the DP is restricted to the certified band around the alignment edges, or uses the sparse DP.
+ */
+class PortfolioMember
+{
+public:
+    Parameters params;
+    Lagrange lagrange;
+    StepSize step;
+    PosPair sequenceIndices;
+    unsigned remainingIterations;
+    unsigned iterations; // the number of iterations, which sets the pruning phase
+    ScoreType bestLower;
+    ScoreType bestUpper;
+
+    std::vector<float> subgradient{};
+    std::vector<ScoreType> dual{};
+    std::list<size_t> subgradientIndices{};
+    TraceSegments trace{};
+    std::unique_ptr<PairwiseGotoh> gotoh{}; // the DP matrix of the relaxed alignment, kept for reuse
+
+    PortfolioMember(PosPair indices, InputStorage const & store, Parameters const & variant):
+        params(variant),
+        lagrange(store[indices.first], store[indices.second], params, nullptr, 0ul),
+        step{},
+        sequenceIndices{indices},
+        remainingIterations{params.numIterations},
+        iterations{0u},
+        bestLower{-infinity},
+        bestUpper{infinity}
+    {
+        subgradient.resize(lagrange.getDimension());
+        dual.resize(subgradient.size());
+        step.reset(params, dual.size(), false);
+        bestLower = lagrange.primalHeuristic(store[indices.first], store[indices.second], subgradient,
+                                             subgradientIndices, params.matching, params.rnaScore);
+    }
+
+    /*!
+     * \brief Offer the best valid solution of the member to the other members of the pair.
+     * \param shared The bounds and the best solution that are shared by the members of the pair.
+     * \details The solution replaces the shared one, if it has a higher score, and raises the shared lower bound.
+     */
+    void publish(PortfolioPair & shared) const
+    {
+        ScoreType const score = lagrange.getPrimalScore();
+        if (score <= shared.bestLower.load())
+            return;
+
+        WeightedAlignedColumns lines = lagrange.getStructureLines(params, sequenceIndices);
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (score > shared.bestLinesScore)
+        {
+            shared.bestLines = std::move(lines);
+            shared.bestLinesScore = score;
+            atomicMax(shared.bestLower, score);
+        }
+    }
+
+    /*!
+     * \brief Perform one iteration of the subgradient optimisation.
+     * \param store The input sequences.
+     * \param shared The bounds that are shared by the members of the pair.
+     * \return Whether the member has finished, either because the shared gap has closed or its iterations ran out.
+     * \details When the iterations run out, the member tries to close the shared gap with a branch and bound.
+     */
+    bool iterate(InputStorage const & store, PortfolioPair & shared)
+    {
+        ScoreType currentUpper{};
+        if (lagrange.edgeDensity() < params.sparseDensity)
+        {
+            currentUpper = lagrange.sparseRelaxedAlignment(trace, params.rnaScore);
+        }
+        else if (params.incrementalDP && lagrange.incrementalFits(params.incrementalMemory))
+        {
+            currentUpper = lagrange.incrementalRelaxedAlignment(trace, params.rnaScore);
+        }
+        else
+        {
+            auto relaxedScore = [this] (size_t posA, size_t posB) { return lagrange.getRelaxedScore(posA, posB); };
+            if (!gotoh)
+            {
+                gotoh.reset(new PairwiseGotoh(seqan::length(store[sequenceIndices.first].sequence),
+                                              seqan::length(store[sequenceIndices.second].sequence),
+                                              params.rnaScore.data_gap_open, params.rnaScore.data_gap_extend));
+            }
+
+            // Restrict the DP to a band around the alignment edges, unless its score cannot prove optimality.
+            int lowerDiag{};
+            int upperDiag{};
+            ScoreType certificate{};
+            bool optimal = false;
+            if (lagrange.relaxedBand(lowerDiag, upperDiag, certificate, bestLower, params.rnaScore))
+            {
+                gotoh->compute(relaxedScore, lowerDiag, upperDiag);
+                currentUpper = gotoh->getOptimalScore();
+                optimal = currentUpper >= certificate;
+            }
+            if (!optimal)
+            {
+                gotoh->compute(relaxedScore);
+                currentUpper = gotoh->getOptimalScore();
+            }
+            gotoh->traceback(trace);
+        }
+        ScoreType const currentLower = lagrange.valid_solution(subgradient, subgradientIndices, trace,
+                                                               params.matching, params.rnaScore);
+
+        // compare with the own bounds, which determine the step size adaptation
+        bool improved = false;
+        if (currentUpper < bestUpper)
+        {
+            bestUpper = currentUpper;
+            improved = true;
+        }
+        if (currentLower > bestLower)
+        {
+            bestLower = currentLower;
+            improved = true;
+        }
+        --remainingIterations;
+        ++iterations;
+
+        // exchange the bounds and the best solution with the other members, adopt a better shared solution
+        atomicMin(shared.bestUpper, bestUpper);
+        publish(shared);
+        ScoreType const sharedUpper = shared.bestUpper.load();
+        ScoreType const sharedLower = shared.bestLower.load();
+        SEQAN_ASSERT_GEQ(sharedUpper, sharedLower);
+        bestLower = std::max(bestLower, sharedLower);
+
+        step.update(dual, subgradient, subgradientIndices, currentUpper, sharedUpper, sharedLower, improved);
+
+        auto const epsilon = static_cast<ScoreType>(params.epsilon * factor2int);
+        bool const converged = sharedUpper - sharedLower <= epsilon ||
+                               relativeGapClosed(sharedLower, sharedUpper, params.relativeGap);
+        bool const stable = params.stableRounds > 0u &&
+                            lagrange.getStableRounds() >= params.stableRounds &&
+                            relativeGapClosed(sharedLower, sharedUpper, params.stableGap);
+        if (converged || stable)
+        {
+            shared.finished = true;
+            return true;
+        }
+        if (remainingIterations == 0u)
+        {
+            if (params.bnbNodes > 0u && !shared.finished.load())
+            {
+                atomicMin(shared.bestUpper, lagrange.branchAndBound(sharedUpper, params.bnbNodes, epsilon, subgradient,
+                                                                    subgradientIndices, params.matching,
+                                                                    params.rnaScore));
+                publish(shared);
+                if (shared.bestUpper.load() - shared.bestLower.load() <= epsilon)
+                    shared.finished = true;
+            }
+            return true;
+        }
+
+        lagrange.updateScores(dual, subgradientIndices, params.rnaScore);
+        if (params.pruneInterval > 0u && iterations % params.pruneInterval == 0u)
+            lagrange.pruneEdges(sharedLower, params.rnaScore);
+        return false;
+    }
+};
+
+/*!
+ * \brief Solve fewer pairs of sequences than there are threads, with several portfolio members per pair.
+ * \param results The output library, to which the best alignment of each pair is added.
+ * \param store The input sequences.
+ * \param params The parameters.
+ * \param inputPairs The pairs of sequence indices.
+ * \details
+ * Each thread runs one member. The members are assigned round-robin to the pairs and differ in their step size
+ * strategy, step size factor and matching lookahead. All members of a pair stop as soon as the gap between the
+ * shared bounds closes or the time limit is reached. The iterations of a member are capped by the time budget, and
+ * a member whose iterations run out continues with the branch and bound, if it is enabled. The members publish
+ * their best valid solution to the pair, which writes the best of them as its result. A pair without any started
+ * member is aligned by its sequences only. The warm start of the dual variables is not applied, because the pairs
+ * are solved concurrently.
+ */
+template <typename TPairs>
+void solvePortfolio(OutputLibrary & results, InputStorage const & store, Parameters const & params,
+                    TPairs const & inputPairs)
+{
+    Clock::time_point timePortfolio = Clock::now();
+    size_t const numPairs = inputPairs.size();
+    size_t const numMembers = std::max<size_t>(params.threads, numPairs);
+
+    std::vector<PortfolioPair> pairs(numPairs);
+    auto pairIt = inputPairs.cbegin();
+    for (PortfolioPair & pair : pairs)
+        pair.sequenceIndices = *pairIt++;
+
+    std::vector<std::unique_ptr<PortfolioMember>> members(numMembers);
+    TimeBudget budget(params.timeStart, params.timeLimit, numMembers, params.threads);
+
+    #pragma omp parallel for num_threads(params.threads) schedule(static, 1)
+    for (size_t memberIdx = 0ul; memberIdx < numMembers; ++memberIdx)
+    {
+        PortfolioPair & pair = pairs[memberIdx % numPairs];
+        if (pair.finished.load() || budget.expired())
+            continue;
+
+        members[memberIdx].reset(new PortfolioMember(pair.sequenceIndices, store,
+                                                     portfolioVariant(params, memberIdx / numPairs)));
+        PortfolioMember & member = *members[memberIdx];
+        member.remainingIterations = budget.iterationCap(params.numIterations);
+        member.publish(pair);
+
+        bool finished = pair.finished.load();
+        while (!finished)
+        {
+            Clock::time_point const timeRound = Clock::now();
+            finished = member.iterate(store, pair) || pair.finished.load() || budget.expired();
+            budget.addRound(Clock::now() - timeRound);
+        }
+    } // end parallel for
+
+    // Write the best valid solution of each pair.
+    #pragma omp parallel for num_threads(params.threads) schedule(dynamic)
+    for (size_t pairIdx = 0ul; pairIdx < numPairs; ++pairIdx)
+    {
+        PortfolioPair & pair = pairs[pairIdx];
+        if (pair.bestLinesScore == -infinity)
+        {
+            PosPair const & seqIdx = pair.sequenceIndices;
+            WeightedAlignedColumns lines = sequenceAlignmentLines(store[seqIdx.first].sequence,
+                                                                  store[seqIdx.second].sequence, params, seqIdx);
+            #pragma omp critical (finished_alignment)
+            {
+                results.addAlignment(lines);
+                _LOG(2, "     Time limit: sequence alignment for " << seqIdx.first << "/" << seqIdx.second
+                        << std::endl);
+            }
+            continue;
+        }
+
+        #pragma omp critical (finished_alignment)
+        {
+            results.addAlignment(pair.bestLines);
+            _LOG(2, "     Best alignment " << pair.sequenceIndices.first << "/" << pair.sequenceIndices.second
+                    << ", bounds " << pair.bestLower.load() << " " << pair.bestUpper.load() << std::endl);
+        }
+    }
+
+    _LOG(1, "   * portfolio of " << numMembers << " solvers for " << numPairs << " alignments -> "
+            << timeDiff<std::chrono::seconds>(timePortfolio) << "s" << std::endl);
+}
+
+} // namespace lara
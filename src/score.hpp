@@ -37,8 +37,10 @@
  * \brief This file contains a position-dependent scoring matrix.
  */
 
-#include <algorithm> // std::fill
+#include <algorithm> // std::min, std::max
 #include <limits>    // std::numeric_limits
+#include <utility>   // std::pair
+#include <vector>
 
 #include <seqan/score.h>
 #include <seqan/sequence.h>
@@ -47,6 +49,138 @@
 namespace seqan
 {
 
+// --------------------------------------------------------
+// BANDED STORAGE FOR POSITION SPECIFIC SCORES
+// --------------------------------------------------------
+
+/*!
+ * \brief Stores the cells of a position-specific score matrix row by row, restricted to a band in each row.
+ * \tparam TCell The cell type, i.e. a score or a SIMD vector of scores (one per lane).
+ * \details
+ * A row holds the cells from the first to the last column that one of the bound lanes uses. All other cells
+ * share a single sentinel with the initial value. If a lane is bound that does not fit into the current bands,
+ * the storage is rebuilt for the union of the bound lanes.
+ */
+template <typename TCell>
+class BandedScoreStorage_
+{
+public:
+    typedef std::pair<size_t, size_t> TRange; // [begin, end) of the used columns in a row
+
+private:
+    struct RowInfo
+    {
+        size_t begin;
+        size_t length;
+        size_t offset;
+    };
+
+    String<TCell, Alloc<OverAligned>> cells; // aligned alloc
+    String<RowInfo> rows;
+    std::vector<std::vector<TRange>> laneRanges;
+    TCell sentinel;
+
+    void rebuild()
+    {
+        String<RowInfo> newRows;
+        resize(newRows, length(rows), Exact());
+        size_t total = 0ul;
+        for (size_t row = 0ul; row < length(rows); ++row)
+        {
+            size_t first = std::numeric_limits<size_t>::max();
+            size_t last = 0ul;
+            for (std::vector<TRange> const & ranges : laneRanges)
+            {
+                if (row < ranges.size() && ranges[row].first < ranges[row].second)
+                {
+                    first = std::min(first, ranges[row].first);
+                    last = std::max(last, ranges[row].second);
+                }
+            }
+            newRows[row] = first < last ? RowInfo{first, last - first, total} : RowInfo{0ul, 0ul, total};
+            total += newRows[row].length;
+        }
+
+        // Keep the values of the bound lanes, which lie within both the old and the new band.
+        String<TCell, Alloc<OverAligned>> newCells;
+        resize(newCells, total, sentinel, Exact());
+        for (size_t row = 0ul; row < length(rows); ++row)
+        {
+            RowInfo const & oldInfo = rows[row];
+            RowInfo const & newInfo = newRows[row];
+            size_t const first = std::max(oldInfo.begin, newInfo.begin);
+            size_t const last = std::min(oldInfo.begin + oldInfo.length, newInfo.begin + newInfo.length);
+            for (size_t col = first; col < last; ++col)
+                newCells[newInfo.offset + col - newInfo.begin] = cells[oldInfo.offset + col - oldInfo.begin];
+        }
+        swap(cells, newCells);
+        swap(rows, newRows);
+    }
+
+public:
+    void init(size_t numRows, size_t numLanes, TCell const & initCell)
+    {
+        clear(cells);
+        clear(rows);
+        resize(rows, numRows, RowInfo{0ul, 0ul, 0ul}, Exact());
+        laneRanges.assign(numLanes, std::vector<TRange>{});
+        sentinel = initCell;
+    }
+
+    // Register the columns that a lane uses in each row. The cells of the lane must hold the initial value.
+    void bindLane(size_t lane, std::vector<TRange> const & ranges)
+    {
+        SEQAN_ASSERT_LEQ(ranges.size(), length(rows));
+        laneRanges[lane] = ranges;
+        for (size_t row = 0ul; row < ranges.size(); ++row)
+        {
+            RowInfo const & info = rows[row];
+            if (ranges[row].first < ranges[row].second &&
+                (ranges[row].first < info.begin || ranges[row].second > info.begin + info.length))
+            {
+                rebuild();
+                return;
+            }
+        }
+    }
+
+    // Release the lane. Its cells must have been set back to the initial value.
+    void unbindLane(size_t lane)
+    {
+        laneRanges[lane].clear();
+    }
+
+    // Access to a cell within the band.
+    TCell & cell(size_t row, size_t col)
+    {
+        RowInfo const & info = rows[row];
+        SEQAN_ASSERT_LT(col - info.begin, info.length);
+        return cells[info.offset + col - info.begin];
+    }
+
+    // Read a cell, which is the sentinel outside of the band.
+    TCell const & value(size_t row, size_t col) const
+    {
+        RowInfo const & info = rows[row];
+        size_t const pos = col - info.begin; // wraps around if col < begin
+        return pos < info.length ? cells[info.offset + pos] : sentinel;
+    }
+
+    // Read the band of a row, i.e. the cells of the columns [first, first + len). The other columns hold the sentinel.
+    TCell const * rowBand(size_t row, size_t & first, size_t & len) const
+    {
+        RowInfo const & info = rows[row];
+        first = info.begin;
+        len = info.length;
+        return info.length > 0ul ? &cells[info.offset] : nullptr;
+    }
+
+    TCell const & initialValue() const
+    {
+        return sentinel;
+    }
+};
+
 // --------------------------------------------------------
 // POSITION SPECIFIC SCORE
 // --------------------------------------------------------
@@ -60,32 +194,38 @@ private:
     static TScore const INITVALUE;
 
 public:
-    String<TScore, Alloc<OverAligned>> matrix; // aligned alloc
-    size_t dim; // length of second sequence
+    typedef typename BandedScoreStorage_<TScore>::TRange TRange;
+
+    BandedScoreStorage_<TScore> matrix;
     TScore data_gap_open;
     TScore data_gap_extend;
 
-    void init(size_t dim1, size_t dim2, TScore gapOpen, TScore gapExtend)
+    void init(size_t dim1, size_t /* unused */, TScore gapOpen, TScore gapExtend)
     {
-        resize(matrix, dim1 * dim2, INITVALUE);
-        dim = dim2;
+        matrix.init(dim1, 1ul, INITVALUE);
         data_gap_open = gapOpen;
         data_gap_extend = gapExtend;
     }
 
-    void set(size_t /* unused */, size_t idx1, size_t idx2, TScore value)
+    void bind(size_t /* unused */, std::vector<TRange> const & ranges)
+    {
+        matrix.bindLane(0ul, ranges);
+    }
+
+    void unbind(size_t /* unused */)
     {
-        matrix[dim * idx1 + idx2] = value;
+        matrix.unbindLane(0ul);
     }
 
-    void reset(size_t /* unused */)
+    void set(size_t /* unused */, size_t idx1, size_t idx2, TScore value)
     {
-        std::fill(begin(matrix), end(matrix), INITVALUE);
+        matrix.cell(idx1, idx2) = value;
     }
 
-    void updateLongestSeq(StringSet<String<unsigned>> const & /* unused */,
-                          StringSet<String<unsigned>> const & /* unused */,
-                          std::pair<size_t, size_t> /* unused */) {}
+    void unset(size_t /* unused */, size_t idx1, size_t idx2)
+    {
+        matrix.cell(idx1, idx2) = INITVALUE;
+    }
 };
 
 template <typename TScore>
@@ -95,7 +235,7 @@ template <typename TScore, typename TPos>
 inline
 TScore score(Score<TScore, PositionSpecificScore> const & sc, TPos const entryH, TPos const entryV)
 {
-    return sc.matrix[sc.dim * entryH + entryV];
+    return sc.matrix.value(entryH, entryV);
 }
 
 #ifdef SEQAN_SIMD_ENABLED
@@ -114,104 +254,43 @@ private:
     static TScore const INITVALUE;
 
 public:
-    String<SimdScoreType, Alloc<OverAligned>> matrix; // aligned alloc
-    size_t dim; // length of second sequence
+    typedef typename BandedScoreStorage_<SimdScoreType>::TRange TRange;
+
+    BandedScoreStorage_<SimdScoreType> matrix;
     TScore data_gap_open;
     TScore data_gap_extend;
-    uint8_t longestSeqIdx1;
-    uint8_t longestSeqIdx2;
 
-    void init(size_t dim1, size_t dim2, TScore gapOpen, TScore gapExtend)
+    void init(size_t dim1, size_t /* unused */, TScore gapOpen, TScore gapExtend)
     {
-        resize(matrix, dim1 * dim2, createVector<SimdScoreType>(INITVALUE));
-        dim = dim2;
+        matrix.init(dim1, LENGTH<SimdScoreType>::VALUE, createVector<SimdScoreType>(INITVALUE));
         data_gap_open = gapOpen;
         data_gap_extend = gapExtend;
-        longestSeqIdx1 = 0;
-        longestSeqIdx2 = 0;
     }
 
-    inline void set(size_t seq, size_t idx1, size_t idx2, TScore value)
+    void bind(size_t seq, std::vector<TRange> const & ranges)
     {
-        matrix[dim * idx1 + idx2][seq] = value;
+        matrix.bindLane(seq, ranges);
     }
 
-    void reset(size_t seq)
+    void unbind(size_t seq)
     {
-        for (auto & score : matrix)
-            score[seq] = INITVALUE;
+        matrix.unbindLane(seq);
     }
 
-    void updateLongestSeq(StringSet<String<unsigned>> const & seqs1,
-                          StringSet<String<unsigned>> const & seqs2,
-                          std::pair<size_t, size_t> interval)
+    inline void set(size_t seq, size_t idx1, size_t idx2, TScore value)
     {
-        // Comparison function: Returns true if the first sequence is shorter than the second.
-        auto lengthCmp = [] (auto const & a, auto const & b) { return length(a) < length(b); };
-
-        // Store the index of the longest sequence in the first set.
-        auto maxE = std::max_element(begin(seqs1) + interval.first, begin(seqs1) + interval.second, lengthCmp);
-        longestSeqIdx1 = static_cast<uint8_t>(std::distance(begin(seqs1) + interval.first, maxE));
+        matrix.cell(idx1, idx2)[seq] = value;
+    }
 
-        // Store the index of the longest sequence in the second set.
-        maxE = std::max_element(begin(seqs2) + interval.first, begin(seqs2) + interval.second, lengthCmp);
-        longestSeqIdx2 = static_cast<uint8_t>(std::distance(begin(seqs2) + interval.first, maxE));
+    inline void unset(size_t seq, size_t idx1, size_t idx2)
+    {
+        matrix.cell(idx1, idx2)[seq] = INITVALUE;
     }
 };
 
 template <typename TScore>
 TScore const Score<TScore, PositionSpecificScoreSimd>::INITVALUE = std::numeric_limits<TScore>::lowest() / 3 * 2;
 
-template <typename TScore, typename TPosVec>
-inline
-typename seqan::SimdVector<TScore>::Type score(Score<TScore, PositionSpecificScoreSimd> const & sc,
-                                                  TPosVec const entryH,
-                                                  TPosVec const entryV)
-{
-    // The entry vectors consist of the same values, so we can always use the entry of the longest sequence.
-    return sc.matrix[sc.dim * entryH[sc.longestSeqIdx1] + entryV[sc.longestSeqIdx2]];
-}
-
-// --------------------------------------------------------
-// WRAPPER FOR POSITION SPECIFIC SCORE WITH SIMD
-// --------------------------------------------------------
-
-template <typename TScoreVec>
-class Score<TScoreVec, ScoreSimdWrapper<Score<int32_t, PositionSpecificScoreSimd>>>
-{
-public:
-    using TVecValue = typename Value<TScoreVec>::Type;
-    using TBaseScoreSpec = typename Spec<Score<int32_t, PositionSpecificScoreSimd>>::Type;
-    using TBaseScore = Score<typename IfC<sizeof(TVecValue) <= 2,
-                                          int32_t,
-                                          typename IfC<sizeof(TVecValue) == 8, int64_t, TVecValue>::Type
-                                         >::Type,
-                             TBaseScoreSpec>;
-
-    // The score type is a ScoreMatrix.
-    TScoreVec data_gap_extend = createVector<TScoreVec>(-1);
-    TScoreVec data_gap_open   = createVector<TScoreVec>(-1);
-    TBaseScore _baseScore;
-
-    // Default Constructor.
-    Score() = default;
-
-    template <typename TScoreVal2, typename TScoreSpec2>
-    explicit Score(Score<TScoreVal2, TScoreSpec2> const & pScore) :
-        data_gap_extend(createVector<TScoreVec>(scoreGapExtend(pScore))),
-        data_gap_open(createVector<TScoreVec>(scoreGapOpen(pScore))),
-        _baseScore(pScore)
-    {}
-};
-
-template <typename TValue, typename TVal1, typename TVal2>
-TValue score(Score<TValue, ScoreSimdWrapper<Score<int32_t, PositionSpecificScoreSimd>>> const & sc,
-             TVal1 const & val1,
-             TVal2 const & val2)
-{
-    return score(sc._baseScore, val1, val2);
-}
-
 #endif
 
 } // namespace seqan
@@ -0,0 +1,671 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+#pragma once
+
+/*!\file simd_alignment.hpp
+ * \brief This file contains the SIMD alignment kernels for the position-specific scores.
+ */
+
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <seqan/align.h>
+#include <seqan/simd.h>
+
+#include "data_types.hpp"
+
+namespace lara
+{
+
+//!\brief The matrix of a Gotoh DP cell. The trace matrices store the origins in M, H and V in two bits each.
+enum class GotohState : uint8_t { MATCH, GAP_A, GAP_B };
+uint8_t const gotohShiftH = 2u;
+uint8_t const gotohShiftV = 4u;
+
+//!\brief The trace code for the given origin in the given matrix.
+inline ScoreType gotohCode(GotohState state, uint8_t shift)
+{
+    return static_cast<ScoreType>(static_cast<uint8_t>(state) << shift);
+}
+
+//!\brief Replace the maximum and its origin in the lanes, where the candidate is greater.
+template <typename TVector>
+inline void improveMax(TVector & best, TVector & origin, TVector const & candidate, TVector const & code)
+{
+    auto const greater = seqan::cmpGt(candidate, best);
+    best = seqan::blend(best, candidate, greater);
+    origin = seqan::blend(origin, code, greater);
+}
+
+/*!
+ * \brief Trace back an optimal alignment through the origins of the Gotoh DP cells.
+ * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+ * \param posA The length of the first sequence.
+ * \param posB The length of the second sequence.
+ * \param state The matrix that holds the optimal score in the last cell.
+ * \param origin Callable that returns the trace code of the cell (posA, posB) for positive positions.
+ * \details Gaps in the second sequence are HORIZONTAL and gaps in the first sequence are VERTICAL segments.
+ */
+template <typename TOrigin>
+void gotohTraceback(TraceSegments & trace, size_t posA, size_t posB, GotohState state, TOrigin && origin)
+{
+    typedef seqan::TraceBitMap_<> TraceBitMap;
+
+    seqan::clear(trace);
+    while (posA > 0ul && posB > 0ul)
+    {
+        uint8_t const code = origin(posA, posB);
+        if (state == GotohState::MATCH)
+        {
+            --posA;
+            --posB;
+            seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::DIAGONAL));
+            state = static_cast<GotohState>(code & 3u);
+        }
+        else if (state == GotohState::GAP_A) // matrix H: a position of the second sequence is aligned to a gap
+        {
+            --posB;
+            seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::VERTICAL));
+            state = static_cast<GotohState>((code >> gotohShiftH) & 3u);
+        }
+        else // matrix V: a position of the first sequence is aligned to a gap
+        {
+            --posA;
+            seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::HORIZONTAL));
+            state = static_cast<GotohState>((code >> gotohShiftV) & 3u);
+        }
+    }
+
+    // leading gaps
+    while (posA > 0ul)
+    {
+        --posA;
+        seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::HORIZONTAL));
+    }
+    while (posB > 0ul)
+    {
+        --posB;
+        seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::VERTICAL));
+    }
+}
+
+/*!
+ * \brief Global Gotoh alignments of several sequence pairs at once, one pair in each lane of a SIMD vector.
+ * \tparam TVector The SIMD vector type of the scores.
+ * \details
+ * The lanes share a position-specific score matrix, whose cells hold a SIMD vector with one score per lane. The DP
+ * runs over the rows of the longest lane and reads the band of each score row directly. A cell depends only on the
+ * cells above and to the left of it, so the result of each lane is read at the end of its own sequences. The
+ * recurrences and the tie breaking are the same as in PairwiseGotoh. The DP can be restricted to a band of
+ * diagonals, which is shared by the lanes. The trace matrix holds one byte per lane and cell. The DP rows and the
+ * trace matrix are kept for reuse in the next iteration.
+ */
+template <typename TVector>
+class SimdGotoh
+{
+private:
+    enum : size_t { numLanes = seqan::LENGTH<TVector>::VALUE };
+
+    typedef seqan::String<TVector, seqan::Alloc<seqan::OverAligned>> VectorString;
+
+    VectorString rowM;
+    VectorString rowH;
+    VectorString rowV;
+    std::vector<ScoreType> rowTrace;  // the trace codes of the current row, one per lane and cell
+    std::vector<uint8_t> traceMatrix; // the trace codes of all cells, with the lanes of a cell next to each other
+    size_t columns{0ul};
+    std::array<PosPair, numLanes> laneLengths{};
+    std::array<GotohState, numLanes> endState{};
+
+public:
+    /*!
+     * \brief Compute the optimal alignment scores of all lanes.
+     * \param[out] result The score of the optimal alignment in each lane.
+     * \param score The position-specific score, which provides the banded score matrix of the lanes.
+     * \param lengths The lengths of the first and the second sequence in each lane. Unused lanes have length zero.
+     * \param go The gap open score.
+     * \param ge The gap extend score.
+     */
+    template <typename TScore>
+    void align(TVector & result, TScore const & score, std::array<PosPair, numLanes> const & lengths,
+               ScoreType go, ScoreType ge)
+    {
+        align(result, score, lengths, go, ge, std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+    }
+
+    /*!
+     * \brief Compute the best alignment scores of all lanes within a band of diagonals.
+     * \param[out] result The score of the best alignment within the band in each lane.
+     * \param score The position-specific score, which provides the banded score matrix of the lanes.
+     * \param lengths The lengths of the first and the second sequence in each lane. Unused lanes have length zero.
+     * \param go The gap open score.
+     * \param ge The gap extend score.
+     * \param lowerDiag The lower diagonal of the band, where the diagonal of a cell is posA - posB.
+     * \param upperDiag The upper diagonal of the band.
+     * \details
+     * The band must contain the first and the last cell of each lane, i.e. lowerDiag <= 0 <= upperDiag and
+     * lowerDiag <= lenA - lenB <= upperDiag. Only the cells within the band are computed, the others are -infinity.
+     * The result is the optimal score of a lane, if its optimal alignment does not leave the band.
+     */
+    template <typename TScore>
+    void align(TVector & result, TScore const & score, std::array<PosPair, numLanes> const & lengths,
+               ScoreType go, ScoreType ge, int lowerDiag, int upperDiag)
+    {
+        laneLengths = lengths;
+        size_t rows = 0ul;
+        columns = 0ul;
+        for (PosPair const & len : lengths)
+        {
+            rows = std::max(rows, len.first);
+            columns = std::max(columns, len.second);
+        }
+
+        seqan::resize(rowM, columns + 1ul);
+        seqan::resize(rowH, columns + 1ul);
+        seqan::resize(rowV, columns + 1ul);
+        rowTrace.resize(columns * numLanes);
+        traceMatrix.resize(rows * columns * numLanes);
+
+        TVector const minusInf = seqan::createVector<TVector>(-infinity);
+        TVector const gapOpen = seqan::createVector<TVector>(go);
+        TVector const gapExtend = seqan::createVector<TVector>(ge);
+        TVector const zero = seqan::createVector<TVector>(0);
+        TVector const codeGapA = seqan::createVector<TVector>(gotohCode(GotohState::GAP_A, 0u));
+        TVector const codeGapB = seqan::createVector<TVector>(gotohCode(GotohState::GAP_B, 0u));
+        TVector const codeGapAinH = seqan::createVector<TVector>(gotohCode(GotohState::GAP_A, gotohShiftH));
+        TVector const codeGapBinH = seqan::createVector<TVector>(gotohCode(GotohState::GAP_B, gotohShiftH));
+        TVector const codeGapAinV = seqan::createVector<TVector>(gotohCode(GotohState::GAP_A, gotohShiftV));
+        TVector const codeGapBinV = seqan::createVector<TVector>(gotohCode(GotohState::GAP_B, gotohShiftV));
+        TVector const & sentinel = score.matrix.initialValue();
+
+        // Read the results of the lanes, whose first sequence ends in the given row.
+        auto finishLanes = [this, &result] (size_t row)
+        {
+            for (size_t lane = 0ul; lane < numLanes; ++lane)
+            {
+                if (laneLengths[lane].first != row)
+                    continue;
+
+                size_t const col = laneLengths[lane].second;
+                ScoreType best = rowM[col][lane];
+                endState[lane] = GotohState::MATCH;
+                if (rowH[col][lane] > best)
+                {
+                    best = rowH[col][lane];
+                    endState[lane] = GotohState::GAP_A;
+                }
+                if (rowV[col][lane] > best)
+                {
+                    best = rowV[col][lane];
+                    endState[lane] = GotohState::GAP_B;
+                }
+                result[lane] = best;
+            }
+        };
+
+        // The columns of the band in a DP row, as the range of the cells b, which compute the DP column b + 1.
+        auto cellRange = [lowerDiag, upperDiag, this] (size_t row)
+        {
+            int64_t const firstColumn = std::max<int64_t>(1, static_cast<int64_t>(row) - upperDiag);
+            int64_t const lastColumn = std::min<int64_t>(columns, static_cast<int64_t>(row) - lowerDiag);
+            int64_t const cellBegin = std::min<int64_t>(firstColumn - 1, columns);
+            return std::make_pair(static_cast<size_t>(cellBegin), static_cast<size_t>(std::max(lastColumn, cellBegin)));
+        };
+        auto clearColumn = [&] (size_t col)
+        {
+            rowM[col] = minusInf;
+            rowH[col] = minusInf;
+            rowV[col] = minusInf;
+        };
+
+        // initialise the first row, the column after the band is read by the next row
+        rowM[0] = zero;
+        rowH[0] = minusInf;
+        rowV[0] = minusInf;
+        size_t const firstRowEnd = cellRange(0ul).second;
+        for (size_t b = 0ul; b < firstRowEnd; ++b)
+        {
+            rowM[b + 1ul] = seqan::createVector<TVector>(go + ge * static_cast<ScoreType>(b));
+            rowH[b + 1ul] = rowM[b + 1ul];
+            rowV[b + 1ul] = minusInf;
+        }
+        if (firstRowEnd < columns)
+            clearColumn(firstRowEnd + 1ul);
+        finishLanes(0ul);
+
+        for (size_t a = 0ul; a < rows; ++a)
+        {
+            size_t cellBegin;
+            size_t cellEnd;
+            std::tie(cellBegin, cellEnd) = cellRange(a + 1ul);
+
+            // the maximum of the previous row in the diagonal predecessor
+            TVector diagBest = rowM[cellBegin];
+            TVector diagOrigin = zero;
+            improveMax(diagBest, diagOrigin, rowH[cellBegin], codeGapA);
+            improveMax(diagBest, diagOrigin, rowV[cellBegin], codeGapB);
+
+            // the left neighbour of the band is the first column or outside of the band
+            if (cellBegin == 0ul && static_cast<int64_t>(a) < upperDiag)
+            {
+                rowM[0] = seqan::createVector<TVector>(go + ge * static_cast<ScoreType>(a));
+                rowH[0] = minusInf;
+                rowV[0] = rowM[0];
+            }
+            else
+            {
+                clearColumn(cellBegin);
+            }
+
+            auto cell = [&] (size_t b, TVector const & matchScore)
+            {
+                TVector const upM = rowM[b + 1ul];
+                TVector const upH = rowH[b + 1ul];
+                TVector const upV = rowV[b + 1ul];
+
+                // matrix H: gap in the first sequence, from the left neighbour
+                TVector bestH = rowM[b] + gapOpen;
+                TVector originH = zero;
+                improveMax(bestH, originH, rowH[b] + gapExtend, codeGapAinH);
+                improveMax(bestH, originH, rowV[b] + gapOpen, codeGapBinH);
+
+                // matrix V: gap in the second sequence, from the upper neighbour
+                TVector bestV = upM + gapOpen;
+                TVector originV = zero;
+                improveMax(bestV, originV, upH + gapOpen, codeGapAinV);
+                improveMax(bestV, originV, upV + gapExtend, codeGapBinV);
+
+                rowM[b + 1ul] = diagBest + matchScore;
+                rowH[b + 1ul] = bestH;
+                rowV[b + 1ul] = bestV;
+                seqan::storeu(&rowTrace[b * numLanes], diagOrigin | originH | originV);
+
+                diagBest = upM;
+                diagOrigin = zero;
+                improveMax(diagBest, diagOrigin, upH, codeGapA);
+                improveMax(diagBest, diagOrigin, upV, codeGapB);
+            };
+
+            // The cells outside of the band of this score row hold the sentinel.
+            size_t first;
+            size_t len;
+            TVector const * band = score.matrix.rowBand(a, first, len);
+            size_t const scoreBegin = std::min(std::max(first, cellBegin), cellEnd);
+            size_t const scoreEnd = std::max(std::min(first + len, cellEnd), scoreBegin);
+            size_t b = cellBegin;
+            for (; b < scoreBegin; ++b)
+                cell(b, sentinel);
+            for (; b < scoreEnd; ++b)
+                cell(b, band[b - first]);
+            for (; b < cellEnd; ++b)
+                cell(b, sentinel);
+            if (cellEnd < columns)
+                clearColumn(cellEnd + 1ul);
+
+            uint8_t * traceRow = &traceMatrix[a * columns * numLanes];
+            for (size_t idx = cellBegin * numLanes; idx < cellEnd * numLanes; ++idx)
+                traceRow[idx] = static_cast<uint8_t>(rowTrace[idx]);
+
+            finishLanes(a + 1ul);
+        }
+    }
+
+    /*!
+     * \brief Compute the trace of an optimal alignment in one lane of the last align call.
+     * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+     * \param lane The lane of the alignment.
+     * \details Gaps in the second sequence are HORIZONTAL and gaps in the first sequence are VERTICAL segments.
+     */
+    void traceback(TraceSegments & trace, size_t lane) const
+    {
+        gotohTraceback(trace, laneLengths[lane].first, laneLengths[lane].second, endState[lane],
+                       [this, lane] (size_t posA, size_t posB)
+                       {
+                           return traceMatrix[((posA - 1ul) * columns + posB - 1ul) * numLanes + lane];
+                       });
+    }
+};
+
+/*!
+ * \brief Global Gotoh alignment of a single large sequence pair, which uses the vector lanes and several threads.
+ * \tparam TVector The SIMD vector type of the scores.
+ * \details
+ * The DP matrix is divided into tiles, and the tiles on the same anti-diagonal are computed in parallel by the
+ * threads (wavefront). Within a tile, a stripe of as many rows as the vector has lanes is computed in a skewed way:
+ * lane r holds row r of the stripe and lags r columns behind the first lane, such that the upper and the diagonal
+ * predecessor of a cell have been computed by the previous lane in the two preceding steps. Only the borders of the
+ * tiles and one trace code per cell are stored. The recurrences and the tie breaking are the same as in
+ * PairwiseGotoh.
+ */
+template <typename TVector>
+class WavefrontGotoh
+{
+private:
+    enum : size_t { numLanes = seqan::LENGTH<TVector>::VALUE, tileRows = 16ul * numLanes, tileColumns = 256ul };
+
+    // The number of tiles in each dimension, below which the first and last anti-diagonals leave the threads idle.
+    static constexpr size_t minTiles = 4ul;
+
+    // The entries of the matrices M, H and V in a cell.
+    struct Cell
+    {
+        ScoreType m;
+        ScoreType h;
+        ScoreType v;
+    };
+
+    // The buffers of a thread for computing a tile, which are sized for the widest tile.
+    struct Scratch
+    {
+        std::vector<Cell> row;             // the row above the current stripe
+        std::vector<ScoreType> skewedScores;
+        std::vector<ScoreType> skewedTrace;
+    };
+
+    size_t lenA{0ul};
+    size_t lenB{0ul};
+    std::vector<Scratch> scratch;     // one for each thread
+    std::vector<Cell> borderRows;     // row 0 and the last row of each tile row
+    std::vector<Cell> borderColumns;  // column 0 and the last column of each tile column
+    std::vector<uint8_t> traceMatrix; // the trace code of each cell, except the first row and column
+    GotohState endState{GotohState::MATCH};
+
+    //!\brief The vector of the previous lanes, with the given value in the first lane.
+    static TVector shiftLanes(TVector const & vec, ScoreType first)
+    {
+        std::array<ScoreType, numLanes + 1ul> buffer;
+        seqan::storeu(buffer.data() + 1, vec);
+        buffer[0] = first;
+        return seqan::loadu<TVector>(buffer.data());
+    }
+
+    //!\brief Compute the DP cells of a tile from its upper and left border, and store its lower and right border.
+    template <typename TScore>
+    void computeTile(size_t tileA, size_t tileB, TScore const & score, size_t scoreLane, ScoreType go, ScoreType ge,
+                     Scratch & buffers)
+    {
+        size_t const rowBegin = tileA * tileRows;
+        size_t const rowEnd = std::min(rowBegin + tileRows, lenA);
+        size_t const colBegin = tileB * tileColumns;
+        size_t const width = std::min(colBegin + tileColumns, lenB) - colBegin;
+        Cell const * upperBorder = &borderRows[tileA * (lenB + 1ul) + colBegin];
+        Cell const * leftBorder = &borderColumns[tileB * (lenA + 1ul)];
+        Cell * lowerBorder = &borderRows[(tileA + 1ul) * (lenB + 1ul) + colBegin];
+        Cell * rightBorder = &borderColumns[(tileB + 1ul) * (lenA + 1ul)];
+
+        TVector const gapOpen = seqan::createVector<TVector>(go);
+        TVector const gapExtend = seqan::createVector<TVector>(ge);
+        TVector const zero = seqan::createVector<TVector>(0);
+        TVector const codeGapA = seqan::createVector<TVector>(gotohCode(GotohState::GAP_A, 0u));
+        TVector const codeGapB = seqan::createVector<TVector>(gotohCode(GotohState::GAP_B, 0u));
+        TVector const codeGapAinH = seqan::createVector<TVector>(gotohCode(GotohState::GAP_A, gotohShiftH));
+        TVector const codeGapBinH = seqan::createVector<TVector>(gotohCode(GotohState::GAP_B, gotohShiftH));
+        TVector const codeGapAinV = seqan::createVector<TVector>(gotohCode(GotohState::GAP_A, gotohShiftV));
+        TVector const codeGapBinV = seqan::createVector<TVector>(gotohCode(GotohState::GAP_B, gotohShiftV));
+        std::array<ScoreType, numLanes> indices;
+        for (size_t lane = 0ul; lane < numLanes; ++lane)
+            indices[lane] = static_cast<ScoreType>(lane);
+        TVector const laneIndex = seqan::loadu<TVector>(indices.data());
+
+        // The row above the current stripe, which the last lane overwrites with the last row of the stripe.
+        std::vector<Cell> & row = buffers.row;
+        std::copy(upperBorder, upperBorder + width + 1ul, row.begin());
+        ScoreType const sentinel = score.matrix.initialValue()[scoreLane];
+
+        // The scores and the trace codes of a stripe are stored skewed, i.e. one vector for each step.
+        std::vector<ScoreType> & skewedScores = buffers.skewedScores;
+        std::vector<ScoreType> & skewedTrace = buffers.skewedTrace;
+        size_t const skewedSize = (width + numLanes) * numLanes;
+        std::array<ScoreType, numLanes> m;
+        std::array<ScoreType, numLanes> h;
+        std::array<ScoreType, numLanes> v;
+
+        for (size_t first = rowBegin; first < rowEnd; first += numLanes)
+        {
+            size_t const height = std::min<size_t>(numLanes, rowEnd - first);
+            row[0] = leftBorder[first];
+
+            // The missing rows of the last stripe and the lanes outside of the tile have zero scores.
+            std::fill(skewedScores.begin(), skewedScores.begin() + skewedSize, 0);
+            for (size_t lane = 0ul; lane < numLanes; ++lane)
+            {
+                if (lane < height)
+                {
+                    size_t bandBegin;
+                    size_t bandLength;
+                    TVector const * band = score.matrix.rowBand(first + lane, bandBegin, bandLength);
+                    for (size_t col = 0ul; col < width; ++col)
+                    {
+                        size_t const pos = colBegin + col - bandBegin; // wraps around if the column is left of the band
+                        skewedScores[(lane + col) * numLanes + lane] = pos < bandLength ? band[pos][scoreLane]
+                                                                                        : sentinel;
+                    }
+                }
+
+                Cell const cell = lane < height ? leftBorder[first + lane + 1ul] : Cell{0, 0, 0};
+                m[lane] = cell.m;
+                h[lane] = cell.h;
+                v[lane] = cell.v;
+            }
+
+            // Each lane starts with the left border of its row, and its diagonal predecessor is the one above.
+            TVector curM = seqan::loadu<TVector>(m.data());
+            TVector curH = seqan::loadu<TVector>(h.data());
+            TVector curV = seqan::loadu<TVector>(v.data());
+            TVector diagBest = shiftLanes(curM, row[0].m);
+            TVector diagOrigin = zero;
+            improveMax(diagBest, diagOrigin, shiftLanes(curH, row[0].h), codeGapA);
+            improveMax(diagBest, diagOrigin, shiftLanes(curV, row[0].v), codeGapB);
+
+            // In each step, lane r computes the column step - r of its row.
+            for (size_t step = 0ul; step + 1ul < width + height; ++step)
+            {
+                size_t const laneBegin = step < width ? 0ul : step - width + 1ul;
+                size_t const laneEnd = std::min(step + 1ul, height);
+                Cell const & above = row[std::min(step + 1ul, width)];
+                TVector const upM = shiftLanes(curM, above.m);
+                TVector const upH = shiftLanes(curH, above.h);
+                TVector const upV = shiftLanes(curV, above.v);
+
+                // matrix H: gap in the first sequence, from the left neighbour
+                TVector bestH = curM + gapOpen;
+                TVector originH = zero;
+                improveMax(bestH, originH, curH + gapExtend, codeGapAinH);
+                improveMax(bestH, originH, curV + gapOpen, codeGapBinH);
+
+                // matrix V: gap in the second sequence, from the upper neighbour
+                TVector bestV = upM + gapOpen;
+                TVector originV = zero;
+                improveMax(bestV, originV, upH + gapOpen, codeGapAinV);
+                improveMax(bestV, originV, upV + gapExtend, codeGapBinV);
+
+                TVector const newM = diagBest + seqan::loadu<TVector>(&skewedScores[step * numLanes]);
+                TVector const code = diagOrigin | originH | originV;
+
+                // Only the lanes within the tile advance, the others keep their left border or last column.
+                auto const active = seqan::cmpGt(laneIndex, seqan::createVector<TVector>(
+                                                                static_cast<ScoreType>(laneBegin) - 1)) &
+                                    seqan::cmpGt(seqan::createVector<TVector>(static_cast<ScoreType>(laneEnd)),
+                                                 laneIndex);
+                curM = seqan::blend(curM, newM, active);
+                curH = seqan::blend(curH, bestH, active);
+                curV = seqan::blend(curV, bestV, active);
+
+                seqan::storeu(&skewedTrace[step * numLanes], code);
+
+                // the last row of the stripe is the row above the next stripe
+                if (laneEnd == height)
+                    row[step - height + 2ul] = Cell{curM[height - 1ul], curH[height - 1ul], curV[height - 1ul]};
+
+                diagBest = upM;
+                diagOrigin = zero;
+                improveMax(diagBest, diagOrigin, upH, codeGapA);
+                improveMax(diagBest, diagOrigin, upV, codeGapB);
+            }
+
+            for (size_t lane = 0ul; lane < height; ++lane)
+            {
+                rightBorder[first + lane + 1ul] = Cell{curM[lane], curH[lane], curV[lane]};
+                uint8_t * trace = &traceMatrix[(first + lane) * lenB + colBegin];
+                for (size_t col = 0ul; col < width; ++col)
+                    trace[col] = static_cast<uint8_t>(skewedTrace[(lane + col) * numLanes + lane]);
+            }
+        }
+
+        std::copy(row.begin() + 1, row.begin() + width + 1ul, lowerBorder + 1);
+    }
+
+public:
+    /*!
+     * \brief Whether the wavefront pays off for a pair of the given lengths.
+     * \param lengthA The length of the first sequence.
+     * \param lengthB The length of the second sequence.
+     * \return True if the DP matrix spans at least minTiles full tiles in each dimension.
+     * \details With fewer tiles, most anti-diagonals hold only one or two tiles, and the synchronisation between them
+     * costs more than the threads save.
+     */
+    static bool suitable(size_t lengthA, size_t lengthB)
+    {
+        return lengthA >= minTiles * tileRows && lengthB >= minTiles * tileColumns;
+    }
+
+    /*!
+     * \brief Compute the optimal alignment score.
+     * \param score The position-specific score, which provides the banded score matrix.
+     * \param scoreLane The lane of the score matrix that holds the scores of the alignment.
+     * \param lengthA The length of the first sequence.
+     * \param lengthB The length of the second sequence.
+     * \param go The gap open score.
+     * \param ge The gap extend score.
+     * \param threads The number of threads that compute the tiles.
+     * \return The score of the optimal alignment.
+     */
+    template <typename TScore>
+    ScoreType align(TScore const & score, size_t scoreLane, size_t lengthA, size_t lengthB, ScoreType go,
+                    ScoreType ge, size_t threads)
+    {
+        lenA = lengthA;
+        lenB = lengthB;
+        size_t const tilesA = (lenA + tileRows - 1ul) / tileRows;
+        size_t const tilesB = (lenB + tileColumns - 1ul) / tileColumns;
+        borderRows.resize((tilesA + 1ul) * (lenB + 1ul));
+        borderColumns.resize((tilesB + 1ul) * (lenA + 1ul));
+        traceMatrix.resize(lenA * lenB);
+        scratch.resize(std::max<size_t>(threads, 1ul));
+        for (Scratch & buffers : scratch)
+        {
+            buffers.row.resize(tileColumns + 1ul);
+            buffers.skewedScores.resize((tileColumns + numLanes) * numLanes);
+            buffers.skewedTrace.resize((tileColumns + numLanes) * numLanes);
+        }
+
+        // initialise the first row and column, and the first cell of each tile border
+        auto firstRow = [go, ge] (size_t b)
+        {
+            return b == 0ul ? Cell{0, -infinity, -infinity}
+                            : Cell{go + ge * static_cast<ScoreType>(b - 1ul), go + ge * static_cast<ScoreType>(b - 1ul),
+                                   -infinity};
+        };
+        auto firstColumn = [go, ge] (size_t a)
+        {
+            return a == 0ul ? Cell{0, -infinity, -infinity}
+                            : Cell{go + ge * static_cast<ScoreType>(a - 1ul), -infinity,
+                                   go + ge * static_cast<ScoreType>(a - 1ul)};
+        };
+        for (size_t b = 0ul; b <= lenB; ++b)
+            borderRows[b] = firstRow(b);
+        for (size_t a = 0ul; a <= lenA; ++a)
+            borderColumns[a] = firstColumn(a);
+        for (size_t tileA = 1ul; tileA <= tilesA; ++tileA)
+            borderRows[tileA * (lenB + 1ul)] = firstColumn(std::min(tileA * tileRows, lenA));
+        for (size_t tileB = 1ul; tileB <= tilesB; ++tileB)
+            borderColumns[tileB * (lenA + 1ul)] = firstRow(std::min(tileB * tileColumns, lenB));
+
+        // The tiles on an anti-diagonal depend only on the tiles of the previous anti-diagonals.
+        for (size_t wave = 0ul; wave + 1ul < tilesA + tilesB; ++wave)
+        {
+            size_t const tileBegin = wave < tilesB ? 0ul : wave - tilesB + 1ul;
+            size_t const tileEnd = std::min(wave + 1ul, tilesA);
+            bool const parallel = threads > 1ul && tileEnd > tileBegin + 1ul;
+            #pragma omp parallel for num_threads(threads) schedule(dynamic) if(parallel)
+            for (size_t tileA = tileBegin; tileA < tileEnd; ++tileA)
+            {
+#ifdef WITH_OPENMP
+                Scratch & buffers = scratch[omp_get_thread_num()];
+#else
+                Scratch & buffers = scratch[0];
+#endif
+                computeTile(tileA, wave - tileA, score, scoreLane, go, ge, buffers);
+            }
+        }
+
+        Cell const & last = borderRows[tilesA * (lenB + 1ul) + lenB];
+        ScoreType best = last.m;
+        endState = GotohState::MATCH;
+        if (last.h > best)
+        {
+            best = last.h;
+            endState = GotohState::GAP_A;
+        }
+        if (last.v > best)
+        {
+            best = last.v;
+            endState = GotohState::GAP_B;
+        }
+        return best;
+    }
+
+    /*!
+     * \brief Compute the trace of an optimal alignment of the last align call.
+     * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+     */
+    void traceback(TraceSegments & trace) const
+    {
+        gotohTraceback(trace, lenA, lenB, endState, [this] (size_t posA, size_t posB)
+        {
+            return traceMatrix[(posA - 1ul) * lenB + posB - 1ul];
+        });
+    }
+};
+
+} // namespace lara
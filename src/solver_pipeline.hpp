@@ -0,0 +1,237 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+
+#pragma once
+
+/*!\file solver_pipeline.hpp
+ * \brief This file contains a pipeline that prepares the solvers for upcoming alignments in the background.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "data_types.hpp"
+#include "dual_store.hpp"
+#include "io.hpp"
+#include "parameters.hpp"
+
+namespace lara
+{
+
+/*!
+ * \brief Sets up the solvers for the remaining pairs of sequences ahead of time.
+ * \tparam TSolver The solver type. It must provide a constructor (pair, store, params, dualStore, score, seqIdx)
+ *                 and a method reset(pair, store, params, dualStore), which both prepare the solver without writing
+ *                 to a score matrix, and its Lagrange object as member lagrange.
+ * \tparam TIter Iterator over the pairs of sequence indices.
+ * \details
+ * A helper thread constructs the solvers for the next pairs, such that a lane, which finished its alignment, is
+ * refilled by swapping in a ready solver. The solvers handed back in exchange are recycled for later pairs.
+ * The ready solvers are limited in number and in their estimated memory, but one solver is always prepared.
+ * If no solver is ready, the calling thread prepares the next pair itself instead of waiting.
+ */
+template <typename TSolver, typename TIter>
+class SolverPipeline
+{
+private:
+    TIter current;
+    TIter const last;
+    InputStorage const & store;
+    Parameters & params;
+    DualStore & dualStore;
+
+    // number and memory in bytes of the solvers that are kept ready
+    size_t const capacity;
+    size_t const memoryLimit;
+
+    std::deque<std::unique_ptr<TSolver>> ready;
+    size_t readyMemory;
+    std::vector<std::unique_ptr<TSolver>> spare;
+    size_t preparing;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable available;
+    bool stop;
+    std::thread helper;
+
+    void prepare()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wakeup.wait(lock, [this]
+            {
+                return stop || (current != last && ready.size() < capacity && readyMemory < memoryLimit);
+            });
+            if (stop || current == last)
+                return;
+
+            PosPair const pair = *current;
+            ++current;
+            ++preparing;
+            std::unique_ptr<TSolver> solver{};
+            if (!spare.empty())
+            {
+                solver = std::move(spare.back());
+                spare.pop_back();
+            }
+            lock.unlock();
+
+            if (solver)
+                solver->reset(pair, store, params, dualStore);
+            else
+                solver.reset(new TSolver(pair, store, params, dualStore, nullptr, 0ul));
+
+            size_t const memory = solver->lagrange.memoryEstimate();
+            lock.lock();
+            readyMemory += memory;
+            ready.push_back(std::move(solver));
+            --preparing;
+            available.notify_all();
+        }
+    }
+
+public:
+    /*!
+     * \brief Start the helper thread, unless the capacity is zero.
+     * \param first The first pair of sequence indices that is prepared.
+     * \param end The end of the pairs.
+     * \param inputStore The input sequences.
+     * \param parameters The parameters.
+     * \param duals The memory of the dual values for warm-starting the solvers.
+     * \param cap The maximal number of ready solvers.
+     * \param megabytes The maximal estimated memory of the ready solvers in MB.
+     */
+    SolverPipeline(TIter first, TIter end, InputStorage const & inputStore, Parameters & parameters,
+                   DualStore & duals, size_t cap, size_t megabytes) :
+        current{first},
+        last{end},
+        store(inputStore),
+        params(parameters),
+        dualStore(duals),
+        capacity{cap},
+        memoryLimit{megabytes << 20},
+        readyMemory{0ul},
+        preparing{0ul},
+        stop{false}
+    {
+        if (capacity > 0ul && current != last)
+            helper = std::thread(&SolverPipeline::prepare, this);
+    }
+
+    SolverPipeline()                                   = delete;
+    SolverPipeline(SolverPipeline const &)             = delete;
+    SolverPipeline(SolverPipeline &&)                  = delete;
+    SolverPipeline & operator=(SolverPipeline const &) = delete;
+    SolverPipeline & operator=(SolverPipeline &&)      = delete;
+
+    ~SolverPipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wakeup.notify_all();
+        if (helper.joinable())
+            helper.join();
+    }
+
+    /*!
+     * \brief Refill a lane with the solver for the next pair of sequences.
+     * \param solver The solver of the finished lane, which is replaced by the solver for the next pair.
+     * \return False if there are no more pairs to align, true otherwise.
+     * \details The new solver is not bound to a score matrix yet.
+     */
+    bool next(TSolver & solver)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // The last pairs may still be in preparation.
+        available.wait(lock, [this] { return !ready.empty() || current != last || preparing == 0ul; });
+        if (!ready.empty())
+        {
+            std::unique_ptr<TSolver> prepared = std::move(ready.front());
+            ready.pop_front();
+            readyMemory -= std::min(readyMemory, prepared->lagrange.memoryEstimate());
+            std::swap(solver, *prepared);
+            spare.push_back(std::move(prepared));
+            lock.unlock();
+            wakeup.notify_one();
+            return true;
+        }
+
+        if (current == last)
+            return false;
+
+        // Nothing is ready: do the setup in the calling thread.
+        PosPair const pair = *current;
+        ++current;
+        lock.unlock();
+        solver.reset(pair, store, params, dualStore);
+        return true;
+    }
+
+    /*!
+     * \brief Stop the preparation and take the pairs that have not been handed out.
+     * \return The pairs of sequence indices, which have not been started. Afterwards next() returns false.
+     */
+    std::vector<PosPair> cancel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wakeup.notify_all();
+        if (helper.joinable())
+            helper.join();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<PosPair> remaining{};
+        for (std::unique_ptr<TSolver> const & solver : ready)
+            remaining.push_back(solver->sequenceIndices);
+        for (; current != last; ++current)
+            remaining.push_back(*current);
+        ready.clear();
+        readyMemory = 0ul;
+        return remaining;
+    }
+};
+
+} // namespace lara
@@ -0,0 +1,272 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+#pragma once
+
+/*!\file sparse_alignment.hpp
+ * \brief This file contains a sparse DP for alignments, in which only few matches are allowed.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include <seqan/align.h>
+
+#include "data_types.hpp"
+
+namespace lara
+{
+
+/*!
+ * \brief Global alignment with affine gaps, where only a given set of matches is allowed.
+ * \details
+ * The DP runs over the allowed matches instead of the cells of the matrix. Between two consecutive matches there
+ * is at most one gap in each sequence, whose score follows from the distance of the matches. The predecessors of a
+ * match are split into four cases: the diagonal neighbour, the matches in the previous row, the matches in the
+ * previous column and the matches that are separated by gaps in both sequences. The last case is answered by a
+ * Fenwick tree of prefix maxima over the columns, into which the matches are inserted two rows late. The running
+ * time is O(n log m) for n matches and m columns. The buffers are kept for reuse.
+ */
+class SparseAlignment
+{
+public:
+    //!\brief An allowed match: position in the first sequence, position in the second sequence and score.
+    typedef std::tuple<size_t, size_t, ScoreType> Match;
+
+private:
+    // markers for a missing score and for the start of the alignment as predecessor
+    enum : int64_t { none = std::numeric_limits<int64_t>::min() / 4 };
+    enum : size_t { start = std::numeric_limits<size_t>::max() };
+
+    std::vector<int64_t> best;             // score of the best alignment that ends with each match
+    std::vector<size_t> predecessor;       // the previous match on that alignment, or start
+    std::vector<size_t> rowBegin;          // index of the first match in each row, and a sentinel
+    std::vector<int64_t> rowPrefix;        // prefix maxima of best - posB * ge within each row
+    std::vector<size_t> rowPrefixArg;
+    std::vector<int64_t> columnBest;       // maximum of best - posA * ge of the inserted matches in each column
+    std::vector<size_t> columnArg;
+    std::vector<int64_t> fenwick;          // prefix maxima of best - (posA + posB) * ge of the inserted matches
+    std::vector<size_t> fenwickArg;
+    std::vector<size_t> path;
+
+    void fenwickInsert(size_t posB, int64_t value, size_t arg)
+    {
+        for (size_t pos = posB + 1ul; pos < fenwick.size(); pos += pos & (~pos + 1ul))
+        {
+            if (value > fenwick[pos])
+            {
+                fenwick[pos] = value;
+                fenwickArg[pos] = arg;
+            }
+        }
+    }
+
+    //!\brief The maximum over the columns [0, end) and its argument.
+    std::pair<int64_t, size_t> fenwickQuery(size_t end) const
+    {
+        std::pair<int64_t, size_t> result{none, start};
+        for (size_t pos = end; pos > 0ul; pos -= pos & (~pos + 1ul))
+            if (fenwick[pos] > result.first)
+                result = {fenwick[pos], fenwickArg[pos]};
+        return result;
+    }
+
+    //!\brief Append a run of gaps in reverse order of the alignment, like SeqAn stores its trace.
+    static void appendGap(TraceSegments & trace, size_t posA, size_t posB, size_t length, uint8_t traceValue)
+    {
+        if (length > 0ul)
+            seqan::appendValue(trace, TraceSegment(posA, posB, length, traceValue));
+    }
+
+public:
+    /*!
+     * \brief Compute an optimal alignment.
+     * \param lengthA The length of the first sequence.
+     * \param lengthB The length of the second sequence.
+     * \param matches The allowed matches, sorted by the first and then by the second position.
+     * \param go The gap open score.
+     * \param ge The gap extend score.
+     * \param[out] trace The trace segments, stored from the end to the beginning of the alignment like in SeqAn.
+     * \return The score of the alignment.
+     */
+    ScoreType align(size_t lengthA, size_t lengthB, std::vector<Match> const & matches, ScoreType go, ScoreType ge,
+                    TraceSegments & trace)
+    {
+        typedef seqan::TraceBitMap_<> TraceBitMap;
+
+        // the score of a gap with the given length
+        auto gap = [go, ge] (size_t length) -> int64_t
+        {
+            return length == 0ul ? 0 : go + static_cast<int64_t>(length - 1ul) * ge;
+        };
+        int64_t const extend = ge;
+        size_t const num = matches.size();
+
+        best.assign(num, none);
+        predecessor.assign(num, start);
+        rowBegin.assign(lengthA + 1ul, num);
+        for (size_t idx = num; idx > 0ul; --idx)
+            rowBegin[std::get<0>(matches[idx - 1ul])] = idx - 1ul;
+        for (size_t row = lengthA; row > 0ul; --row)
+            rowBegin[row - 1ul] = std::min(rowBegin[row - 1ul], rowBegin[row]);
+        rowPrefix.assign(num, none);
+        rowPrefixArg.assign(num, start);
+        columnBest.assign(lengthB, none);
+        columnArg.assign(lengthB, start);
+        fenwick.assign(lengthB + 1ul, none);
+        fenwickArg.assign(lengthB + 1ul, start);
+
+        size_t inserted = 0ul; // the matches before this index are in the column maxima and the Fenwick tree
+        for (size_t idx = 0ul; idx < num; ++idx)
+        {
+            size_t const posA = std::get<0>(matches[idx]);
+            size_t const posB = std::get<1>(matches[idx]);
+
+            // insert the matches that are at least two rows above
+            for (; inserted < num && std::get<0>(matches[inserted]) + 2ul <= posA; ++inserted)
+            {
+                size_t const qA = std::get<0>(matches[inserted]);
+                size_t const qB = std::get<1>(matches[inserted]);
+                if (best[inserted] - static_cast<int64_t>(qA) * extend > columnBest[qB])
+                {
+                    columnBest[qB] = best[inserted] - static_cast<int64_t>(qA) * extend;
+                    columnArg[qB] = inserted;
+                }
+                fenwickInsert(qB, best[inserted] - static_cast<int64_t>(qA + qB) * extend, inserted);
+            }
+
+            // from the start of the alignment
+            int64_t value = gap(posA) + gap(posB);
+            size_t arg = start;
+            auto consider = [&value, &arg] (int64_t candidate, size_t candidateArg)
+            {
+                if (candidate > value)
+                {
+                    value = candidate;
+                    arg = candidateArg;
+                }
+            };
+
+            if (posA > 0ul && posB > 0ul)
+            {
+                // diagonal neighbour and the matches in the previous row with a gap in the first sequence
+                size_t const rowFirst = rowBegin[posA - 1ul];
+                size_t const rowEnd = rowBegin[posA];
+                Match const diagonalMatch{posA - 1ul, posB - 1ul, std::numeric_limits<ScoreType>::min()};
+                auto const rowIt = std::lower_bound(matches.begin() + rowFirst, matches.begin() + rowEnd,
+                                                    diagonalMatch);
+                size_t const diagonal = rowIt - matches.begin();
+                if (diagonal < rowEnd && std::get<1>(*rowIt) == posB - 1ul)
+                    consider(best[diagonal], diagonal);
+                if (diagonal > rowFirst)
+                {
+                    consider(rowPrefix[diagonal - 1ul] + go + static_cast<int64_t>(posB - 2ul) * extend,
+                             rowPrefixArg[diagonal - 1ul]);
+                }
+
+                // the matches in the previous column with a gap in the second sequence
+                if (columnArg[posB - 1ul] != start)
+                    consider(columnBest[posB - 1ul] + go + static_cast<int64_t>(posA - 2ul) * extend,
+                             columnArg[posB - 1ul]);
+
+                // the matches with gaps in both sequences
+                if (posB > 1ul)
+                {
+                    std::pair<int64_t, size_t> const both = fenwickQuery(posB - 1ul);
+                    if (both.second != start)
+                        consider(both.first + 2 * go + static_cast<int64_t>(posA + posB - 4ul) * extend,
+                                 both.second);
+                }
+            }
+
+            best[idx] = value + std::get<2>(matches[idx]);
+            predecessor[idx] = arg;
+
+            // prefix maxima within the row
+            int64_t const rowValue = best[idx] - static_cast<int64_t>(posB) * extend;
+            bool const rowStart = idx == 0ul || std::get<0>(matches[idx - 1ul]) != posA;
+            if (rowStart || rowValue > rowPrefix[idx - 1ul])
+            {
+                rowPrefix[idx] = rowValue;
+                rowPrefixArg[idx] = idx;
+            }
+            else
+            {
+                rowPrefix[idx] = rowPrefix[idx - 1ul];
+                rowPrefixArg[idx] = rowPrefixArg[idx - 1ul];
+            }
+        }
+
+        // the end of the alignment
+        int64_t total = gap(lengthA) + gap(lengthB);
+        size_t last = start;
+        for (size_t idx = 0ul; idx < num; ++idx)
+        {
+            int64_t const candidate = best[idx] + gap(lengthA - 1ul - std::get<0>(matches[idx]))
+                                      + gap(lengthB - 1ul - std::get<1>(matches[idx]));
+            if (candidate > total)
+            {
+                total = candidate;
+                last = idx;
+            }
+        }
+
+        // trace back from the end, a gap in the second sequence precedes a gap in the first sequence
+        path.clear();
+        for (size_t idx = last; idx != start; idx = predecessor[idx])
+            path.push_back(idx);
+
+        seqan::clear(trace);
+        size_t endA = lengthA;
+        size_t endB = lengthB;
+        for (size_t idx : path)
+        {
+            size_t const posA = std::get<0>(matches[idx]);
+            size_t const posB = std::get<1>(matches[idx]);
+            appendGap(trace, endA, posB + 1ul, endB - posB - 1ul, TraceBitMap::VERTICAL);
+            appendGap(trace, posA + 1ul, posB + 1ul, endA - posA - 1ul, TraceBitMap::HORIZONTAL);
+            seqan::appendValue(trace, TraceSegment(posA, posB, 1u, TraceBitMap::DIAGONAL));
+            endA = posA;
+            endB = posB;
+        }
+        appendGap(trace, endA, 0ul, endB, TraceBitMap::VERTICAL);
+        appendGap(trace, 0ul, 0ul, endA, TraceBitMap::HORIZONTAL);
+
+        return static_cast<ScoreType>(std::max<int64_t>(std::min<int64_t>(total, infinity), -infinity));
+    }
+};
+
+} // namespace lara
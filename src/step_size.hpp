@@ -0,0 +1,352 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+
+#pragma once
+
+/*!\file step_size.hpp
+ * \brief This file contains the step size strategies for the subgradient optimisation.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "data_types.hpp"
+#include "parameters.hpp"
+
+namespace lara
+{
+
+/*!
+ * \brief Computes the steps of the subgradient optimisation and updates the dual variables.
+ * \details
+ * All strategies move the dual variables against the subgradient with a step length that is proportional to a
+ * gap between the bounds and inversely proportional to the squared norm of the direction.
+ *
+ * * HALVING: the gap between the best bounds; the factor is halved after a number of non-improving iterations.
+ * * POLYAK: the gap between the current upper bound and a target value, which starts at the best lower bound
+ *   and is moved halfway towards the best upper bound after a number of non-improving iterations.
+ * * DEFLECTED: like HALVING, but the direction is the subgradient plus a multiple of the previous direction
+ *   (Camerini, Fratta and Maffioli), which dampens the zig-zagging of consecutive subgradients.
+ * * BUNDLE: a proximal bundle method with two cuts, the new subgradient and the aggregate of the previous ones
+ *   (Kiwiel), whose quadratic subproblem has a closed-form solution. The step starts at the stability center,
+ *   the dual variables with the lowest upper bound so far, which only moves if the upper bound decreases by a
+ *   fraction of the decrease that the model predicted. The proximal weight is the step length of HALVING.
+ *
+ * There is one object per pair of sequences, which is reset for each new pair.
+ */
+class StepSize
+{
+private:
+    // factor for weighting the previous direction in the deflection
+    static constexpr float deflectionWeight = 1.5f;
+    // entries of the deflected direction and of the aggregate subgradient below this value are dropped
+    static constexpr float minDirection = 1e-3f;
+    // fraction of the predicted decrease of the upper bound, which moves the stability center of the bundle method
+    static constexpr float seriousFraction = 0.1f;
+
+    UnsignedType strategy{StepSizeStrategy::HALVING};
+    UnsignedType maxNondecreasing{};
+    size_t nondecreasingRounds{};
+    float factor{};
+    float targetFraction{};
+
+    std::vector<float> direction{};      // the deflected direction, or the aggregate subgradient of the bundle
+    std::vector<bool> inDirection{};
+    std::vector<size_t> directionIndices{};
+
+    // the bundle method: the offset of the stability center from the dual variables, and the cut values
+    std::vector<float> centerOffset{};
+    std::vector<bool> inOffset{};
+    std::vector<size_t> offsetIndices{};
+    bool hasCenter{};
+    float centerValue{};
+    float aggregateError{};
+    float predictedDecrease{};
+
+    // Deflect the subgradient with the previous direction and return the squared norm of the new direction.
+    float deflect(std::vector<float> & subgradient, std::list<size_t> & subgradientIndices)
+    {
+        float product = 0.0f;
+        float norm = 0.0f;
+        for (size_t idx : directionIndices)
+            norm += direction[idx] * direction[idx];
+        for (size_t idx : subgradientIndices)
+            product += subgradient[idx] * direction[idx];
+
+        // Deflect only if the subgradient points against the previous direction.
+        float const beta = norm > 0.0f ? std::max(0.0f, -deflectionWeight * product / norm) : 0.0f;
+        for (size_t idx : directionIndices)
+            direction[idx] *= beta;
+
+        for (size_t idx : subgradientIndices)
+        {
+            if (!inDirection[idx])
+            {
+                inDirection[idx] = true;
+                directionIndices.push_back(idx);
+            }
+            direction[idx] += subgradient[idx];
+            subgradient[idx] = 0.0f;
+        }
+
+        // Drop the vanishing entries and report the changed dual variables as new subgradient indices.
+        norm = 0.0f;
+        subgradientIndices.clear();
+        auto last = std::remove_if(directionIndices.begin(), directionIndices.end(), [&] (size_t idx)
+        {
+            if (std::abs(direction[idx]) >= minDirection)
+                return false;
+            direction[idx] = 0.0f;
+            inDirection[idx] = false;
+            return true;
+        });
+        directionIndices.erase(last, directionIndices.end());
+        for (size_t idx : directionIndices)
+        {
+            norm += direction[idx] * direction[idx];
+            subgradientIndices.push_back(idx);
+        }
+        return norm;
+    }
+
+    // Add an index to a sparse vector with its flags.
+    static void addIndex(std::vector<bool> & flags, std::vector<size_t> & indices, size_t idx)
+    {
+        if (!flags[idx])
+        {
+            flags[idx] = true;
+            indices.push_back(idx);
+        }
+    }
+
+    // Take a step of the proximal bundle method and report the changed dual variables as new subgradient indices.
+    void bundleStep(std::vector<ScoreType> & dual,
+                    std::vector<float> & subgradient,
+                    std::list<size_t> & subgradientIndices,
+                    ScoreType currentUpper,
+                    float gap)
+    {
+        // linearisation error of the new cut at the stability center, which moves on a sufficient decrease
+        auto const upper = static_cast<float>(currentUpper);
+        float newError = 0.0f;
+        if (!hasCenter || upper <= centerValue - seriousFraction * predictedDecrease)
+        {
+            float shift = 0.0f; // aggregate cut at the new center
+            for (size_t idx : offsetIndices)
+                shift += direction[idx] * centerOffset[idx];
+            aggregateError = hasCenter ? std::max(0.0f, aggregateError + upper - centerValue + shift) : 0.0f;
+            for (size_t idx : offsetIndices)
+            {
+                centerOffset[idx] = 0.0f;
+                inOffset[idx] = false;
+            }
+            offsetIndices.clear();
+            centerValue = upper;
+            hasCenter = true;
+        }
+        else
+        {
+            float product = 0.0f;
+            for (size_t idx : subgradientIndices)
+                product += subgradient[idx] * centerOffset[idx];
+            newError = std::max(0.0f, centerValue - upper - product);
+        }
+
+        // the weight of the new cut minimises t/2 |theta g + (1 - theta) a|^2 + theta e + (1 - theta) E
+        float normNew = 0.0f;
+        float normAggregate = 0.0f;
+        float product = 0.0f;
+        for (size_t idx : subgradientIndices)
+        {
+            normNew += subgradient[idx] * subgradient[idx];
+            product += subgradient[idx] * direction[idx];
+        }
+        for (size_t idx : directionIndices)
+            normAggregate += direction[idx] * direction[idx];
+        if (normNew == 0.0f)
+            return;
+
+        float const weight = factor * gap / normNew;
+        float const normDiff = normNew - 2.0f * product + normAggregate;
+        float theta = 1.0f;
+        if (!directionIndices.empty() && normDiff > 0.0f)
+        {
+            theta = (weight * (normAggregate - product) - (newError - aggregateError)) / (weight * normDiff);
+            theta = std::min(1.0f, std::max(0.0f, theta));
+        }
+
+        // the new aggregate
+        for (size_t idx : directionIndices)
+            direction[idx] *= 1.0f - theta;
+        for (size_t idx : subgradientIndices)
+        {
+            addIndex(inDirection, directionIndices, idx);
+            direction[idx] += theta * subgradient[idx];
+            subgradient[idx] = 0.0f;
+        }
+        aggregateError = theta * newError + (1.0f - theta) * aggregateError;
+        auto last = std::remove_if(directionIndices.begin(), directionIndices.end(), [&] (size_t idx)
+        {
+            if (std::abs(direction[idx]) >= minDirection)
+                return false;
+            direction[idx] = 0.0f;
+            inDirection[idx] = false;
+            return true;
+        });
+        directionIndices.erase(last, directionIndices.end());
+        normAggregate = 0.0f;
+        for (size_t idx : directionIndices)
+            normAggregate += direction[idx] * direction[idx];
+        predictedDecrease = weight * normAggregate + aggregateError;
+
+        // step from the center against the aggregate, the offset keeps the rounding of the dual variables
+        subgradientIndices.clear();
+        for (size_t idx : directionIndices)
+            addIndex(inOffset, offsetIndices, idx);
+        for (size_t idx : offsetIndices)
+        {
+            auto const updated = static_cast<ScoreType>(dual[idx] + centerOffset[idx] - weight * direction[idx]);
+            centerOffset[idx] -= static_cast<float>(updated - dual[idx]);
+            if (updated != dual[idx])
+                subgradientIndices.push_back(idx);
+            dual[idx] = updated;
+        }
+    }
+
+public:
+    /*!
+     * \brief Prepare the step size computation for a new pair of sequences.
+     * \param params The parameters, which contain the strategy and the initial factor.
+     * \param dimension The number of dual variables.
+     * \param smallSteps Whether to start with the half factor, e.g. for warm-started dual variables.
+     */
+    void reset(Parameters const & params, size_t dimension, bool smallSteps)
+    {
+        strategy = params.stepSizeStrategy;
+        maxNondecreasing = params.maxNondecrIterations;
+        nondecreasingRounds = 0ul;
+        factor = smallSteps ? params.stepSizeFactor / 2.0f : params.stepSizeFactor;
+        targetFraction = 0.0f;
+
+        if (strategy == StepSizeStrategy::DEFLECTED || strategy == StepSizeStrategy::BUNDLE)
+        {
+            direction.assign(dimension, 0.0f);
+            inDirection.assign(dimension, false);
+            directionIndices.clear();
+        }
+        if (strategy == StepSizeStrategy::BUNDLE)
+        {
+            centerOffset.assign(dimension, 0.0f);
+            inOffset.assign(dimension, false);
+            offsetIndices.clear();
+            hasCenter = false;
+            centerValue = 0.0f;
+            aggregateError = 0.0f;
+            predictedDecrease = 0.0f;
+        }
+    }
+
+    /*!
+     * \brief Update the dual variables with a step against the subgradient.
+     * \param dual The dual variables.
+     * \param subgradient The subgradient, which is set to zero afterwards.
+     * \param subgradientIndices The indices of the non-zero subgradient entries. On return they contain the
+     *                           indices of all changed dual variables.
+     * \param currentUpper The upper bound of the current iteration.
+     * \param bestUpper The best upper bound so far.
+     * \param bestLower The best lower bound so far.
+     * \param improved Whether one of the best bounds has improved in the current iteration.
+     */
+    void update(std::vector<ScoreType> & dual,
+                std::vector<float> & subgradient,
+                std::list<size_t> & subgradientIndices,
+                ScoreType currentUpper,
+                ScoreType bestUpper,
+                ScoreType bestLower,
+                bool improved)
+    {
+        if (improved)
+            nondecreasingRounds = 0ul;
+
+        // if the limit of nondecreasing iterations is reached then use smaller steps
+        if (nondecreasingRounds++ >= maxNondecreasing)
+        {
+            if (strategy == StepSizeStrategy::POLYAK)
+                targetFraction = (targetFraction + 1.0f) / 2.0f;
+            else
+                factor /= 2.0f;
+            nondecreasingRounds = 0ul;
+        }
+
+        auto const gap = static_cast<float>(static_cast<int64_t>(bestUpper) - bestLower);
+
+        if (strategy == StepSizeStrategy::BUNDLE)
+        {
+            if (!subgradientIndices.empty())
+                bundleStep(dual, subgradient, subgradientIndices, currentUpper, gap);
+            return;
+        }
+
+        if (strategy == StepSizeStrategy::DEFLECTED)
+        {
+            if (subgradientIndices.empty())
+                return;
+
+            float const norm = deflect(subgradient, subgradientIndices);
+            if (norm == 0.0f)
+                return;
+
+            float const stepSize = factor * gap / norm;
+            for (size_t si : directionIndices)
+                dual[si] -= stepSize * direction[si];
+            return;
+        }
+
+        float stepSize = factor * gap / subgradientIndices.size();
+        if (strategy == StepSizeStrategy::POLYAK)
+            stepSize = factor * (static_cast<float>(static_cast<int64_t>(currentUpper) - bestLower) -
+                                 targetFraction * gap) / subgradientIndices.size();
+
+        for (size_t si : subgradientIndices)
+        {
+            dual[si] -= stepSize * subgradient[si];
+            subgradient[si] = 0.0f;
+        }
+    }
+};
+
+} // namespace lara
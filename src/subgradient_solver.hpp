@@ -53,10 +53,15 @@
 #include <seqan/simd.h>
 
 #include "data_types.hpp"
+#include "dual_store.hpp"
 #include "io.hpp"
 #include "lagrange.hpp"
 #include "parameters.hpp"
+#include "portfolio.hpp"
 #include "score.hpp"
+#include "solver_pipeline.hpp"
+#include "step_size.hpp"
+#include "time_budget.hpp"
 
 namespace lara
 {
@@ -73,9 +78,9 @@ class SubgradientSolver
 {
 public:
     Lagrange lagrange;
-    float stepSizeFactor;
-    size_t nondecreasingRounds;
+    StepSize step;
     unsigned remainingIterations;
+    unsigned iterations; // the number of iterations for the current pair, which sets the pruning phase
     PosPair sequenceIndices;
     BoundInfo bounds;
 
@@ -83,26 +88,64 @@ public:
     std::vector<ScoreType> dual{};
     std::list<size_t> subgradientIndices{};
 
+    // whether the dual variables have been initialised from previous alignments
+    bool warmStarted{false};
+
     SubgradientSolver(PosPair indices,
                       InputStorage const & store,
                       Parameters & params,
+                      DualStore & dualStore,
                       RnaScoreType * score,
                       size_t seqIdx):
-        lagrange(store[indices.first], store[indices.second], params, score, seqIdx),
-        stepSizeFactor{params.stepSizeFactor},
-        nondecreasingRounds{0ul},
+        lagrange(store[indices.first], store[indices.second], params, nullptr, seqIdx),
+        step{},
         remainingIterations{params.numIterations},
+        iterations{0u},
         sequenceIndices{indices},
         bounds{-infinity, infinity, -infinity, infinity}
     {
         subgradient.resize(lagrange.getDimension());
         dual.resize(subgradient.size());
+        initDuals(params, dualStore);
+        initLowerBound(store, params);
+        lagrange.bind(score, seqIdx);
     }
 
+    // Reuse the solver and its memory for a new pair of sequences.
+    void reset(PosPair indices, InputStorage const & store, Parameters & params, DualStore & dualStore)
+    {
+        lagrange.reset(store[indices.first], store[indices.second], params);
+        remainingIterations = params.numIterations;
+        iterations = 0u;
+        sequenceIndices = indices;
+        bounds = {-infinity, infinity, -infinity, infinity};
+        subgradient.assign(lagrange.getDimension(), 0.f);
+        dual.assign(subgradient.size(), 0);
+        subgradientIndices.clear();
+        initDuals(params, dualStore);
+        initLowerBound(store, params);
+    }
+
+    // Seed the dual variables from previous alignments, if requested. A warm start proceeds with smaller steps.
+    void initDuals(Parameters const & params, DualStore & dualStore)
+    {
+        warmStarted = params.warmStart && lagrange.warmStart(dual, dualStore, sequenceIndices, params.rnaScore) > 0ul;
+        step.reset(params, dual.size(), warmStarted);
+    }
+
+    // Start with the lower bound of a heuristic solution.
+    void initLowerBound(InputStorage const & store, Parameters const & params)
+    {
+        bounds.bestLower = lagrange.primalHeuristic(store[sequenceIndices.first], store[sequenceIndices.second],
+                                                    subgradient, subgradientIndices, params.matching,
+                                                    params.rnaScore);
+    }
+
+    // A copy would share the node pool of the interactions with the original, therefore only moves are allowed.
     SubgradientSolver()                                      = delete;
-    SubgradientSolver(SubgradientSolver const &)             = default;
+    SubgradientSolver(SubgradientSolver const &)             = delete;
     SubgradientSolver(SubgradientSolver &&)                  = default;
-    SubgradientSolver & operator=(SubgradientSolver const &) = default;
+    SubgradientSolver & operator=(SubgradientSolver const &) = delete;
     SubgradientSolver & operator=(SubgradientSolver &&)      = default;
     ~SubgradientSolver()                                     = default;
 };
@@ -123,6 +166,13 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
     if (inputPairs.empty())
         return;
 
+    // With fewer pairs than threads, the idle threads solve the same pairs with different configurations.
+    if (inputPairs.size() < params.threads)
+    {
+        solvePortfolio(results, store, params, inputPairs);
+        return;
+    }
+
 #ifdef SEQAN_SIMD_ENABLED
     size_t const simd_len = seqan::LENGTH<typename seqan::SimdVector<ScoreType>::Type>::VALUE;
 #else
@@ -131,24 +181,24 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
 
     // Determine number of parallel alignments.
     Clock::time_point timeInit = Clock::now();
-    size_t const num_parallel = std::min(simd_len * params.threads, inputPairs.size());
+    // If the pairs do not fit into the lanes of all threads, one thread prepares the solvers for the remaining pairs.
+    bool const helperThread = params.threads > 1u && inputPairs.size() > simd_len * params.threads;
+    size_t const laneThreads = helperThread ? params.threads - 1u : params.threads;
+    size_t const num_parallel = std::min(simd_len * laneThreads, inputPairs.size());
     size_t const num_threads = (num_parallel - 1) / simd_len + 1;
 
     // We iterate over all pairs of input sequences, starting with the longest.
     auto iter = inputPairs.cbegin(); // iter -> pair of sequence indices
 
-    // Initialise the alignments.
-    std::vector<std::pair<seqan::StringSet<GappedSeq>, seqan::StringSet<GappedSeq>>> alignments(num_threads);
-
     // Integer sequence from 0 until length of longest seq -1
-    seqan::String<unsigned> integerSeq;
+    PositionSeq integerSeq;
     seqan::resize(integerSeq, seqan::length(store[iter->first].sequence));
     std::iota(begin(integerSeq), end(integerSeq), 0u);
 
     // Store the integer sequences.
-    using PrefixType = seqan::Prefix<seqan::String<unsigned>>::Type;
-    seqan::StringSet<seqan::String<unsigned>> seq1;
-    seqan::StringSet<seqan::String<unsigned>> seq2;
+    using PrefixType = seqan::Prefix<PositionSeq>::Type;
+    seqan::StringSet<PositionSeq> seq1;
+    seqan::StringSet<PositionSeq> seq2;
     seqan::reserve(seq1, num_parallel);
     seqan::reserve(seq2, num_parallel);
 
@@ -157,6 +207,13 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
     size_t const max_2nd_length = seqan::length(store[iter->second].sequence);
     auto const go = static_cast<ScoreType>(params.rnaScore.data_gap_open);
     auto const ge = static_cast<ScoreType>(params.rnaScore.data_gap_extend);
+    auto const epsilon = static_cast<ScoreType>(params.epsilon * factor2int);
+
+    // Memory of the dual values for warm-starting the solvers.
+    DualStore dualStore(store.size());
+
+    // The time limit determines the number of iterations for each pair.
+    TimeBudget budget(params.timeStart, params.timeLimit, inputPairs.size(), num_parallel);
 
     // Initialise the solvers.
     std::vector<SubgradientSolver> solvers;
@@ -168,61 +225,119 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
         size_t const seqIdx = solvers.size() % simd_len;
         auto const len = std::make_pair(length(store[iter->first].sequence), length(store[iter->second].sequence));
 
-        // Once for each chunk of size simd_len.
+        // Once for each chunk of size simd_len: initialise the scores.
         if (seqIdx == 0)
         {
-            // Initialise the alignments.
-            seqan::reserve(alignments[aliIdx].first, simd_len);
-            seqan::reserve(alignments[aliIdx].second, simd_len);
-
-            // Initialise the scores.
             scores[aliIdx].init(len.first, std::min(max_2nd_length, len.first), go, ge);
             _LOG(2, "     Resize matrix: " << len.first << "*" << std::min(max_2nd_length, len.first) << std::endl);
         }
 
-        // Fill the alignments.
+        // Fill the sequences.
         appendValue(seq1, PrefixType(integerSeq, len.first));
         appendValue(seq2, PrefixType(integerSeq, len.second));
-        appendValue(alignments[aliIdx].first, GappedSeq(seqan::back(seq1)));
-        appendValue(alignments[aliIdx].second, GappedSeq(seqan::back(seq2)));
 
         // Fill the solvers.
-        solvers.emplace_back(*iter, store, params, &(scores[aliIdx]), seqIdx);
+        solvers.emplace_back(*iter, store, params, dualStore, &(scores[aliIdx]), seqIdx);
+        solvers.back().remainingIterations = budget.iterationCap(params.numIterations);
     }
     SEQAN_ASSERT_EQ(num_parallel, solvers.size());
     SEQAN_ASSERT_EQ(num_parallel, seqan::length(seq1));
     SEQAN_ASSERT_EQ(num_parallel, seqan::length(seq2));
-    SEQAN_ASSERT_EQ(num_threads, seqan::length(alignments));
     _LOG(1, "   * set up initial " << num_parallel << " structural alignments -> " << timeDiff(timeInit) << "ms"
             << std::endl);
 
+    // The solvers for the remaining pairs are set up in the background, at most one ready solver per thread.
+    SolverPipeline<SubgradientSolver, decltype(iter)> pipeline(iter, inputPairs.cend(), store, params, dualStore,
+                                                               helperThread ? num_threads : 0ul,
+                                                               params.pipelineMemory);
+
     Clock::duration durationAlign{};
     Clock::duration durationMatching{};
     Clock::duration durationUpdate{};
     Clock::duration durationSerial{};
+    size_t numSparse{};
+    size_t numIncremental{};
+    size_t numBanded{};
+    size_t numFull{};
     Clock::time_point timeIter = Clock::now();
 
     // in parallel for each (SIMD) alignment
-    #pragma omp parallel for num_threads(params.threads)
+    #pragma omp parallel for num_threads(num_threads)
     for (size_t aliIdx = 0ul; aliIdx < num_threads; ++aliIdx)
     {
         Clock::duration durationThreadAlign{};
         Clock::duration durationThreadMatching{};
         Clock::duration durationThreadUpdate{};
+        size_t sparseAlignments{};
+        size_t incrementalAlignments{};
+        size_t bandedAlignments{};
+        size_t fullAlignments{};
         Clock::time_point timeThreadSerial = Clock::now();
-        size_t num_at_work = seqan::length(alignments[aliIdx].first);
-        std::vector<bool> at_work(num_at_work, true);
         auto const interval = std::make_pair(aliIdx * simd_len, std::min((aliIdx + 1) * simd_len, num_parallel));
-        scores[aliIdx].updateLongestSeq(seq1, seq2, interval);
+        size_t num_at_work = interval.second - interval.first;
+        std::vector<bool> at_work(num_at_work, true);
+
+        // the alignment results and the traces of the DP
+        typedef seqan::AlignConfig2<seqan::DPGlobal, seqan::DPBandConfig<seqan::BandOff>> TAlignConfig2;
+        typedef seqan::AlignConfig2<seqan::DPGlobal, seqan::DPBandConfig<seqan::BandOn>> TBandedConfig;
+        std::vector<ScoreType> res(num_at_work);
+        std::vector<TraceSegments> trace(num_at_work);
 
         // loop the thread until there is no more work to do
         while (num_at_work > 0ul)
         {
+            // At the time limit, all alignments are finished with their best solution so far.
+            bool const expired = budget.expired();
+            Clock::time_point const timeRound = Clock::now();
+
             // Performs the structural alignment. Returns the dual value (upper bound, solution of relaxed problem).
             Clock::time_point timeCurrent = Clock::now();
-            seqan::String<ScoreType> res = seqan::globalAlignment(alignments[aliIdx].first,
-                                                                  alignments[aliIdx].second,
-                                                                  scores[aliIdx]);
+            for (size_t idx = interval.first; idx < interval.second; ++idx)
+            {
+                size_t const seqIdx = idx % simd_len;
+                if (!at_work[seqIdx])
+                    continue;
+
+                // Few alignment edges are aligned with the sparse DP.
+                SubgradientSolver & ss = solvers[idx];
+                if (ss.lagrange.edgeDensity() < params.sparseDensity)
+                {
+                    res[seqIdx] = ss.lagrange.sparseRelaxedAlignment(trace[seqIdx], params.rnaScore);
+                    ++sparseAlignments;
+                    continue;
+                }
+
+                if (params.incrementalDP && ss.lagrange.incrementalFits(params.incrementalMemory))
+                {
+                    res[seqIdx] = ss.lagrange.incrementalRelaxedAlignment(trace[seqIdx], params.rnaScore);
+                    ++incrementalAlignments;
+                    continue;
+                }
+
+                // Restrict the DP to a band around the alignment edges, unless its score cannot prove optimality.
+                int lowerDiag{};
+                int upperDiag{};
+                ScoreType certificate{};
+                if (ss.lagrange.relaxedBand(lowerDiag, upperDiag, certificate, ss.bounds.bestLower, params.rnaScore))
+                {
+                    seqan::clear(trace[seqIdx]);
+                    seqan::DPScoutState_<seqan::Default> dpScoutState;
+                    res[seqIdx] = seqan::_setUpAndRunAlignment(trace[seqIdx], dpScoutState, seq1[idx], seq2[idx],
+                                                               scores[aliIdx], TBandedConfig(lowerDiag, upperDiag),
+                                                               seqan::AffineGaps());
+                    if (res[seqIdx] >= certificate)
+                    {
+                        ++bandedAlignments;
+                        continue;
+                    }
+                }
+
+                seqan::clear(trace[seqIdx]);
+                seqan::DPScoutState_<seqan::Default> dpScoutState;
+                res[seqIdx] = seqan::_setUpAndRunAlignment(trace[seqIdx], dpScoutState, seq1[idx], seq2[idx],
+                                                           scores[aliIdx], TAlignConfig2(), seqan::AffineGaps());
+                ++fullAlignments;
+            }
             durationThreadAlign += Clock::now() - timeCurrent;
 
             // Evaluate each alignment result and adapt multipliers.
@@ -237,40 +352,24 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
 
                 timeCurrent = Clock::now();
                 ss.bounds.currentLower = ss.lagrange.valid_solution(ss.subgradient, ss.subgradientIndices,
-                                                                  std::make_pair(alignments[aliIdx].first[seqIdx],
-                                                                                 alignments[aliIdx].second[seqIdx]),
-                                                                  params.matching,
-                                                                  params.rnaScore);
+                                                                    trace[seqIdx], params.matching, params.rnaScore);
                 durationThreadMatching += Clock::now() - timeCurrent;
 
                 // compare upper and lower bound
+                bool improved = false;
                 if (ss.bounds.currentUpper < ss.bounds.bestUpper)
                 {
                     ss.bounds.bestUpper = ss.bounds.currentUpper;
-                    ss.nondecreasingRounds = 0ul;
+                    improved = true;
                 }
 
                 if (ss.bounds.currentLower > ss.bounds.bestLower)
                 {
                     ss.bounds.bestLower = ss.bounds.currentLower;
-                    ss.nondecreasingRounds = 0ul;
-
-                }
-
-                if (ss.nondecreasingRounds++ >= params.maxNondecrIterations)
-                {
-                    ss.stepSizeFactor /= 2.0f;
-                    ss.nondecreasingRounds = 0;
-                }
-
-                float stepSize = ss.stepSizeFactor * static_cast<float>(ss.bounds.bestUpper - ss.bounds.bestLower) /
-                                 ss.subgradientIndices.size();
-                for (size_t si : ss.subgradientIndices)
-                {
-                    ss.dual[si] -= stepSize * ss.subgradient[si];
-                    ss.subgradient[si] = 0.0f;
+                    improved = true;
                 }
                 --ss.remainingIterations;
+                ++ss.iterations;
 
                 SEQAN_ASSERT_MSG(!ss.subgradientIndices.empty() || ss.bounds.currentUpper == ss.bounds.currentLower,
                                  (std::string{"The bounds differ, although there are no subgradients. "} +
@@ -283,52 +382,70 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
                                          seqan::toCString(store[ss.sequenceIndices.first].name) + " and " +
                                          seqan::toCString(store[ss.sequenceIndices.second].name)).c_str());
 
+                ss.step.update(ss.dual, ss.subgradient, ss.subgradientIndices, ss.bounds.currentUpper,
+                               ss.bounds.bestUpper, ss.bounds.bestLower, improved);
+
+                // The bounds are equal up to epsilon, either absolute or relative to the upper bound.
+                bool const converged = ss.bounds.bestUpper - ss.bounds.bestLower <= epsilon ||
+                                       relativeGapClosed(ss.bounds.bestLower, ss.bounds.bestUpper, params.relativeGap);
+
+                // The best solution has not changed for a while and the bounds are close.
+                bool const stable = params.stableRounds > 0u &&
+                                    ss.lagrange.getStableRounds() >= params.stableRounds &&
+                                    relativeGapClosed(ss.bounds.bestLower, ss.bounds.bestUpper, params.stableGap);
+
                 // The alignment is finished.
-                if (ss.bounds.bestUpper == ss.bounds.bestLower || ss.remainingIterations == 0u)
+                if (converged || stable || expired || ss.remainingIterations == 0u)
                 {
-                    PosPair currentSeqIdx{};
+                    // Try to close the remaining gap with a branch and bound.
+                    if (params.bnbNodes > 0u && !converged && !stable && !expired)
+                        ss.lagrange.branchAndBound(ss.bounds.bestUpper, params.bnbNodes, epsilon, ss.subgradient,
+                                                   ss.subgradientIndices, params.matching, params.rnaScore);
+
                     #pragma omp critical (finished_alignment)
                     {
                         // write results
                         results.addAlignment(ss.lagrange.getStructureLines(params, ss.sequenceIndices));
                         _LOG(2, "     Thread " << aliIdx << "." << seqIdx << " finished alignment "
                                 << ss.sequenceIndices.first << "/" << ss.sequenceIndices.second << std::endl);
-
-                        if (iter == inputPairs.cend())
-                        {
-                            at_work[seqIdx] = false;
-                            --num_at_work;
-                        }
-                        else
-                        {
-                            currentSeqIdx = *iter;
-                            ++iter;
-                        }
                     } // end critical region
 
-                    if (at_work[seqIdx])
+                    if (params.warmStart && converged)
+                        ss.lagrange.recordDuals(ss.dual, dualStore, ss.sequenceIndices);
+
+                    // Reset scores.
+                    ss.lagrange.unbind();
+
+                    if (expired || !pipeline.next(solvers[idx]))
                     {
-                        // Reset scores.
-                        scores[aliIdx].reset(seqIdx);
+                        at_work[seqIdx] = false;
+                        --num_at_work;
+                    }
+                    else
+                    {
+                        PosPair const & currentSeqIdx = solvers[idx].sequenceIndices;
 
                         // Set new sequences.
                         seq1[idx] = PrefixType(integerSeq, length(store[currentSeqIdx.first].sequence));
                         seq2[idx] = PrefixType(integerSeq, length(store[currentSeqIdx.second].sequence));
-                        alignments[aliIdx].first[seqIdx] = GappedSeq(seq1[idx]);
-                        alignments[aliIdx].second[seqIdx] = GappedSeq(seq2[idx]);
 
                         // Set new score matrix.
-                        solvers[idx] = SubgradientSolver(currentSeqIdx, store, params, &(scores[aliIdx]), seqIdx);
-                        scores[aliIdx].updateLongestSeq(seq1, seq2, interval);
+                        solvers[idx].lagrange.bind(&(scores[aliIdx]), seqIdx);
+                        solvers[idx].remainingIterations = budget.iterationCap(params.numIterations);
                     }
                 }
                 else
                 {
                     timeCurrent = Clock::now();
                     ss.lagrange.updateScores(ss.dual, ss.subgradientIndices, params.rnaScore);
+
+                    // Remove the alignment edges that cannot be part of a better solution.
+                    if (params.pruneInterval > 0u && ss.iterations % params.pruneInterval == 0u)
+                        ss.lagrange.pruneEdges(ss.bounds.bestLower, params.rnaScore);
                     durationThreadUpdate += Clock::now() - timeCurrent;
                 }
             }
+            budget.addRound(Clock::now() - timeRound);
         }
 
         #pragma omp critical (update_time)
@@ -337,9 +454,28 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
             durationMatching += durationThreadMatching;
             durationUpdate += durationThreadUpdate;
             durationSerial += Clock::now() - timeThreadSerial;
+            numSparse += sparseAlignments;
+            numIncremental += incrementalAlignments;
+            numBanded += bandedAlignments;
+            numFull += fullAlignments;
         }
     } // end parallel for
 
+    // The pairs, which have not been started before the time limit, are aligned by their sequences only.
+    std::vector<PosPair> const cancelledPairs = pipeline.cancel();
+    #pragma omp parallel for num_threads(params.threads) schedule(dynamic)
+    for (size_t idx = 0ul; idx < cancelledPairs.size(); ++idx)
+    {
+        PosPair const & pair = cancelledPairs[idx];
+        WeightedAlignedColumns lines = sequenceAlignmentLines(store[pair.first].sequence, store[pair.second].sequence,
+                                                              params, pair);
+        #pragma omp critical (finished_alignment)
+        {
+            results.addAlignment(lines);
+            _LOG(2, "     Time limit: sequence alignment for " << pair.first << "/" << pair.second << std::endl);
+        }
+    }
+
     auto durationToSeconds = [] (Clock::duration duration)
         { return std::chrono::duration_cast<std::chrono::seconds>(duration).count(); };
 
@@ -347,7 +483,9 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
             << "     (serial: " << durationToSeconds(durationSerial)
             << "s, ali: " << durationToSeconds(durationAlign)
             << "s, match: " << durationToSeconds(durationMatching)
-            << "s, update: " << durationToSeconds(durationUpdate) << "s)" << std::endl);
+            << "s, update: " << durationToSeconds(durationUpdate) << "s)" << std::endl
+            << "     (DP runs: " << numSparse << " sparse, " << numIncremental << " incremental, " << numBanded
+            << " banded, " << numFull << " full)" << std::endl);
 }
 
 } // namespace lara
@@ -41,6 +41,7 @@
 #include <omp.h>
 #endif
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <iterator>
@@ -53,10 +54,16 @@
 #include <seqan/simd.h>
 
 #include "data_types.hpp"
+#include "dual_store.hpp"
 #include "io.hpp"
 #include "lagrange.hpp"
 #include "parameters.hpp"
+#include "portfolio.hpp"
 #include "score.hpp"
+#include "simd_alignment.hpp"
+#include "solver_pipeline.hpp"
+#include "step_size.hpp"
+#include "time_budget.hpp"
 
 namespace lara
 {
@@ -70,8 +77,6 @@ typedef struct
     ScoreVectorType bestUpper;
     ScoreVectorType currentLower;
     ScoreVectorType currentUpper;
-    UnsignedVectorType nondecreasing;
-    ScoreVectorType stepFactor;
     UnsignedVectorType remainingIterations;
 } BoundInfoSimd;
 
@@ -79,28 +84,69 @@ class SubgradientSolver
 {
 public:
     Lagrange lagrange;
+    StepSize step;
     PosPair sequenceIndices;
+    unsigned iterations{0u}; // the number of iterations for the current pair, which sets the pruning phase
 
     std::vector<float> subgradient{};
     std::vector<ScoreType> dual{};
     std::list<size_t> subgradientIndices{};
 
+    // whether the dual variables have been initialised from previous alignments
+    bool warmStarted{false};
+
+    // the score of the heuristic solution, which is the initial lower bound
+    ScoreType initialLower{-infinity};
+
     SubgradientSolver(PosPair indices,
                       InputStorage const & store,
                       Parameters & params,
+                      DualStore & dualStore,
                       RnaScoreType * score,
                       size_t seqIdx):
-        lagrange(store[indices.first], store[indices.second], params, score, seqIdx),
+        lagrange(store[indices.first], store[indices.second], params, nullptr, seqIdx),
+        step{},
         sequenceIndices{indices}
     {
         subgradient.resize(lagrange.getDimension());
         dual.resize(subgradient.size());
+        initDuals(params, dualStore);
+        initLowerBound(store, params);
+        lagrange.bind(score, seqIdx);
+    }
+
+    // Reuse the solver and its memory for a new pair of sequences.
+    void reset(PosPair indices, InputStorage const & store, Parameters & params, DualStore & dualStore)
+    {
+        lagrange.reset(store[indices.first], store[indices.second], params);
+        sequenceIndices = indices;
+        iterations = 0u;
+        subgradient.assign(lagrange.getDimension(), 0.f);
+        dual.assign(subgradient.size(), 0);
+        subgradientIndices.clear();
+        initDuals(params, dualStore);
+        initLowerBound(store, params);
+    }
+
+    // Seed the dual variables from previous alignments, if requested. A warm start proceeds with smaller steps.
+    void initDuals(Parameters const & params, DualStore & dualStore)
+    {
+        warmStarted = params.warmStart && lagrange.warmStart(dual, dualStore, sequenceIndices, params.rnaScore) > 0ul;
+        step.reset(params, dual.size(), warmStarted);
+    }
+
+    // Start with the lower bound of a heuristic solution.
+    void initLowerBound(InputStorage const & store, Parameters const & params)
+    {
+        initialLower = lagrange.primalHeuristic(store[sequenceIndices.first], store[sequenceIndices.second],
+                                                subgradient, subgradientIndices, params.matching, params.rnaScore);
     }
 
+    // A copy would share the node pool of the interactions with the original, therefore only moves are allowed.
     SubgradientSolver()                                      = delete;
-    SubgradientSolver(SubgradientSolver const &)             = default;
+    SubgradientSolver(SubgradientSolver const &)             = delete;
     SubgradientSolver(SubgradientSolver &&)                  = default;
-    SubgradientSolver & operator=(SubgradientSolver const &) = default;
+    SubgradientSolver & operator=(SubgradientSolver const &) = delete;
     SubgradientSolver & operator=(SubgradientSolver &&)      = default;
     ~SubgradientSolver()                                     = default;
 };
@@ -120,42 +166,52 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
     if (inputPairs.empty())
         return;
 
+    // With fewer pairs than threads, the idle threads solve the same pairs with different configurations. Only a
+    // single pair that is large enough for the wavefront is solved by one solver, whose DP uses all the threads.
+    bool const wavefrontPair = inputPairs.size() == 1ul &&
+                               WavefrontGotoh<ScoreVectorType>::suitable(
+                                   seqan::length(store[inputPairs.cbegin()->first].sequence),
+                                   seqan::length(store[inputPairs.cbegin()->second].sequence));
+    if (inputPairs.size() < params.threads && !wavefrontPair)
+    {
+        solvePortfolio(results, store, params, inputPairs);
+        return;
+    }
+
     size_t const simd_len = seqan::LENGTH<typename seqan::SimdVector<ScoreType>::Type>::VALUE;
 
     // Determine number of parallel alignments.
     Clock::time_point timeInit = Clock::now();
-    size_t const num_parallel = std::min(simd_len * params.threads, inputPairs.size());
+    // If the pairs do not fit into the lanes of all threads, one thread prepares the solvers for the remaining pairs.
+    bool const helperThread = params.threads > 1u && inputPairs.size() > simd_len * params.threads;
+    size_t const laneThreads = helperThread ? params.threads - 1u : params.threads;
+    size_t const num_parallel = std::min(simd_len * laneThreads, inputPairs.size());
     size_t const num_threads = (num_parallel - 1) / simd_len + 1;
 
     // We iterate over all pairs of input sequences, starting with the longest.
     auto iter = inputPairs.cbegin(); // iter -> pair of sequence indices
 
-    // Initialise the alignments.
-    std::vector<std::pair<seqan::StringSet<GappedSeq>, seqan::StringSet<GappedSeq>>> alignments(num_threads);
-
-    // Integer sequence from 0 until length of longest seq -1
-    seqan::String<unsigned> integerSeq;
-    seqan::resize(integerSeq, seqan::length(store[iter->first].sequence));
-    std::iota(begin(integerSeq), end(integerSeq), 0u);
-
-    // Store the integer sequences.
-    using PrefixType = seqan::Prefix<seqan::String<unsigned>>::Type;
-    seqan::StringSet<seqan::String<unsigned>> seq1;
-    seqan::StringSet<seqan::String<unsigned>> seq2;
-    seqan::reserve(seq1, num_parallel);
-    seqan::reserve(seq2, num_parallel);
+    // Store the sequence lengths of the alignments.
+    std::vector<PosPair> lengths;
+    lengths.reserve(num_parallel);
 
     // Initialise the scores.
     std::vector<RnaScoreType> scores(num_threads);
     size_t const max_2nd_length = seqan::length(store[iter->second].sequence);
     auto const go = static_cast<ScoreType>(params.rnaScore.data_gap_open);
     auto const ge = static_cast<ScoreType>(params.rnaScore.data_gap_extend);
-    auto const stepFactor = static_cast<ScoreType>(params.stepSizeFactor * factor2int);
 
-    UnsignedVectorType const zeros = seqan::createVector<UnsignedVectorType>(0u);
     UnsignedVectorType const ones = seqan::createVector<UnsignedVectorType>(1u);
-    ScoreVectorType const twos = seqan::createVector<ScoreVectorType>(2);
-    UnsignedVectorType const maxiter = seqan::createVector<UnsignedVectorType>(params.maxNondecrIterations);
+
+    // the bounds are regarded as equal if their difference is at most epsilon, i.e. below epsilon + 1
+    auto const epsilon = static_cast<ScoreType>(params.epsilon * factor2int);
+    ScoreVectorType const gapLimit = seqan::createVector<ScoreVectorType>(epsilon + 1);
+
+    // Memory of the dual values for warm-starting the solvers.
+    DualStore dualStore(store.size());
+
+    // The time limit determines the number of iterations for each pair.
+    TimeBudget budget(params.timeStart, params.timeLimit, inputPairs.size(), num_parallel);
 
     // Initialise the solvers.
     std::vector<SubgradientSolver> solvers;
@@ -167,103 +223,192 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
         size_t const seqIdx = solvers.size() % simd_len;
         auto const len = std::make_pair(length(store[iter->first].sequence), length(store[iter->second].sequence));
 
-        // Once for each chunk of size simd_len.
+        // Once for each chunk of size simd_len: initialise the scores.
         if (seqIdx == 0)
         {
-            // Initialise the alignments.
-            seqan::reserve(alignments[aliIdx].first, simd_len);
-            seqan::reserve(alignments[aliIdx].second, simd_len);
-
-            // Initialise the scores.
             scores[aliIdx].init(len.first, std::min(max_2nd_length, len.first), go, ge);
             _LOG(2, "     Resize matrix: " << len.first << "*" << std::min(max_2nd_length, len.first) << std::endl);
         }
 
-        // Fill the alignments.
-        appendValue(seq1, PrefixType(integerSeq, len.first));
-        appendValue(seq2, PrefixType(integerSeq, len.second));
-        appendValue(alignments[aliIdx].first, GappedSeq(seqan::back(seq1)));
-        appendValue(alignments[aliIdx].second, GappedSeq(seqan::back(seq2)));
+        // Fill the sequence lengths.
+        lengths.push_back(len);
 
         // Fill the solvers.
-        solvers.emplace_back(*iter, store, params, &(scores[aliIdx]), seqIdx);
+        solvers.emplace_back(*iter, store, params, dualStore, &(scores[aliIdx]), seqIdx);
     }
     SEQAN_ASSERT_EQ(num_parallel, solvers.size());
-    SEQAN_ASSERT_EQ(num_parallel, seqan::length(seq1));
-    SEQAN_ASSERT_EQ(num_parallel, seqan::length(seq2));
-    SEQAN_ASSERT_EQ(num_threads, seqan::length(alignments));
+    SEQAN_ASSERT_EQ(num_parallel, lengths.size());
     _LOG(1, "   * set up initial " << num_parallel << " structural alignments -> " << timeDiff(timeInit) << "ms"
             << std::endl);
 
+    // The solvers for the remaining pairs are set up in the background, at most one ready solver per thread.
+    SolverPipeline<SubgradientSolver, decltype(iter)> pipeline(iter, inputPairs.cend(), store, params, dualStore,
+                                                               helperThread ? num_threads : 0ul,
+                                                               params.pipelineMemory);
+
     Clock::duration durationAlign{};
     Clock::duration durationMatching{};
     Clock::duration durationUpdate{};
     Clock::duration durationSerial{};
+    size_t numSparse{};
+    size_t numBanded{};
+    size_t numFull{};
+    size_t numWavefront{};
     Clock::time_point timeIter = Clock::now();
 
+    // The threads without alignments help with the DP of a single remaining pair. A thread borrows its share of the
+    // idle threads for one DP and returns them afterwards. The working, idle and borrowed threads sum up to the
+    // number of threads, because a thread leaves the working threads before it adds itself to the idle threads.
+    std::atomic<size_t> idleThreads{laneThreads - num_threads};
+    std::atomic<size_t> workingThreads{num_threads};
+    auto borrowThreads = [&idleThreads, &workingThreads] ()
+    {
+        size_t idle = idleThreads.load();
+        size_t share{};
+        do
+        {
+            share = idle / std::max<size_t>(workingThreads.load(), 1ul);
+        } while (share > 0ul && !idleThreads.compare_exchange_weak(idle, idle - share));
+        return share;
+    };
+#ifdef WITH_OPENMP
+    int const previousLevels = omp_get_max_active_levels();
+    omp_set_max_active_levels(std::max(previousLevels, 2));
+#endif
+
     // in parallel for each (SIMD) alignment
-    #pragma omp parallel for num_threads(params.threads)
+    #pragma omp parallel for num_threads(num_threads)
     for (size_t aliIdx = 0ul; aliIdx < num_threads; ++aliIdx)
     {
         Clock::duration durationThreadAlign{};
         Clock::duration durationThreadMatching{};
         Clock::duration durationThreadUpdate{};
+        size_t sparseAlignments{};
+        size_t bandedAlignments{};
+        size_t fullAlignments{};
+        size_t wavefrontAlignments{};
         Clock::time_point timeThreadSerial = Clock::now();
         auto const interval = std::make_pair(aliIdx * simd_len, std::min((aliIdx + 1) * simd_len, num_parallel));
         size_t num_at_work = interval.second - interval.first;
         std::vector<bool> at_work(num_at_work, true);
-        scores[aliIdx].updateLongestSeq(seq1, seq2, interval);
         BoundInfoSimd bound{seqan::createVector<ScoreVectorType>(-infinity),
                             seqan::createVector<ScoreVectorType>(infinity),
                             seqan::createVector<ScoreVectorType>(-infinity),
                             seqan::createVector<ScoreVectorType>(infinity),
-                            seqan::createVector<UnsignedVectorType>(0u),
-                            seqan::createVector<ScoreVectorType>(stepFactor),
                             seqan::createVector<UnsignedVectorType>(params.numIterations)};
 
-        // prepare the dependent StringSet for the SIMD alignment
-        seqan::StringSet<std::remove_const_t<typename seqan::Source<GappedSeq>::Type>, seqan::Dependent<> > depSetH;
-        seqan::StringSet<std::remove_const_t<typename seqan::Source<GappedSeq>::Type>, seqan::Dependent<> > depSetV;
-        seqan::reserve(depSetH, simd_len);
-        seqan::reserve(depSetV, simd_len);
+        // Start with the heuristic lower bounds and the iterations that fit into the time limit.
+        for (size_t idx = interval.first; idx < interval.second; ++idx)
+        {
+            bound.bestLower[idx % simd_len] = solvers[idx].initialLower;
+            bound.remainingIterations[idx % simd_len] = budget.iterationCap(params.numIterations);
+        }
+
+        // The alignment kernels and the trace keep their memory for all iterations.
+        SimdGotoh<ScoreVectorType> kernel;
+        WavefrontGotoh<ScoreVectorType> wavefront;
+        std::array<PosPair, simd_len> laneLengths{};
+        TraceSegments trace;
+
+        // The lanes with few alignment edges are aligned with the sparse DP outside of the vector.
+        std::array<bool, simd_len> sparseLane{};
+        std::array<TraceSegments, simd_len> sparseTrace{};
 
         // loop the thread until there is no more work to do
         while (num_at_work > 0ul)
         {
+            // At the time limit, all alignments are finished with their best solution so far.
+            bool const expired = budget.expired();
+            Clock::time_point const timeRound = Clock::now();
+
             // Performs the structural alignment. Returns the dual value (upper bound, solution of relaxed problem).
             Clock::time_point timeCurrent = Clock::now();
-            typedef seqan::AlignConfig2<seqan::DPGlobal, seqan::DPBandConfig<seqan::BandOff>> TAlignConfig2;
-            seqan::Score<ScoreVectorType, seqan::ScoreSimdWrapper<RnaScoreType>> simdScoringScheme(scores[aliIdx]);
-
-            typedef seqan::TraceSegment_<typename seqan::Position<GappedSeq>::Type, typename seqan::Size<GappedSeq>::Type> TraceSegmentType;
-            seqan::StringSet<seqan::String<TraceSegmentType>> trace;
-            seqan::resize(trace, simd_len, seqan::Exact());
 
-            seqan::clear(depSetH);
-            seqan::clear(depSetV);
-            for (size_t idx = 0ul; idx < seqan::length(alignments[aliIdx].first); ++idx)
+            // The finished, the unused and the sparse lanes have empty sequences, so they do not enlarge the DP.
+            laneLengths.fill(PosPair{0ul, 0ul});
+            sparseLane.fill(false);
+            size_t vectorLanes = 0ul;
+            size_t firstAtWork = simd_len;
+            for (size_t idx = interval.first; idx < interval.second; ++idx)
             {
-                seqan::appendValue(depSetH, seqan::source(alignments[aliIdx].first[idx]));
-                seqan::appendValue(depSetV, seqan::source(alignments[aliIdx].second[idx]));
+                size_t const seqIdx = idx % simd_len;
+                if (!at_work[seqIdx])
+                    continue;
+
+                sparseLane[seqIdx] = solvers[idx].lagrange.edgeDensity() < params.sparseDensity;
+                if (sparseLane[seqIdx])
+                    continue;
+
+                laneLengths[seqIdx] = lengths[idx];
+                firstAtWork = std::min(firstAtWork, seqIdx);
+                ++vectorLanes;
             }
-            // fill the last alignment up to reach simd_len
-            for (size_t idx = seqan::length(alignments[aliIdx].first); idx < simd_len; ++idx)
+
+            // A single large pair fills the vector with its own rows and shares the DP with the idle threads.
+            bool const singlePair = vectorLanes == 1ul &&
+                                    WavefrontGotoh<ScoreVectorType>::suitable(laneLengths[firstAtWork].first,
+                                                                             laneLengths[firstAtWork].second);
+            if (singlePair)
             {
-                seqan::appendValue(depSetH, seqan::source(seqan::back(alignments[aliIdx].first)));
-                seqan::appendValue(depSetV, seqan::source(seqan::back(alignments[aliIdx].second)));
+                size_t const borrowed = borrowThreads();
+                bound.currentUpper[firstAtWork] = wavefront.align(scores[aliIdx], firstAtWork,
+                                                                  laneLengths[firstAtWork].first,
+                                                                  laneLengths[firstAtWork].second, go, ge,
+                                                                  1ul + borrowed);
+                idleThreads += borrowed;
+                ++wavefrontAlignments;
             }
+            else if (vectorLanes > 0ul)
+            {
+                // Restrict the DP to the union of the bands of the lanes, unless a lane cannot prove optimality.
+                bool banded = true;
+                int lowerDiag = 0;
+                int upperDiag = 0;
+                std::array<ScoreType, simd_len> certificate{};
+                for (size_t idx = interval.first; banded && idx < interval.second; ++idx)
+                {
+                    size_t const seqIdx = idx % simd_len;
+                    if (!at_work[seqIdx] || sparseLane[seqIdx])
+                        continue;
+
+                    int laneLower{};
+                    int laneUpper{};
+                    banded = solvers[idx].lagrange.relaxedBand(laneLower, laneUpper, certificate[seqIdx],
+                                                               bound.bestLower[seqIdx], params.rnaScore);
+                    lowerDiag = std::min(lowerDiag, laneLower);
+                    upperDiag = std::max(upperDiag, laneUpper);
+                }
+
+                if (banded)
+                {
+                    kernel.align(bound.currentUpper, scores[aliIdx], laneLengths, go, ge, lowerDiag, upperDiag);
+                    for (size_t idx = interval.first; banded && idx < interval.second; ++idx)
+                        banded = !at_work[idx % simd_len] || sparseLane[idx % simd_len] ||
+                                 bound.currentUpper[idx % simd_len] >= certificate[idx % simd_len];
+                }
 
-            seqan::_prepareAndRunSimdAlignment(bound.currentUpper,
-                                               trace,
-                                               depSetH,
-                                               depSetV,
-                                               simdScoringScheme,
-                                               TAlignConfig2(),
-                                               seqan::AffineGaps());
+                if (banded)
+                {
+                    ++bandedAlignments;
+                }
+                else
+                {
+                    kernel.align(bound.currentUpper, scores[aliIdx], laneLengths, go, ge);
+                    ++fullAlignments;
+                }
+            }
 
-            for (size_t idx = 0; idx < at_work.size(); ++idx)
-                if (at_work[idx])
-                    seqan::_adaptTraceSegmentsTo(alignments[aliIdx].first[idx], alignments[aliIdx].second[idx], trace[idx]);
+            // The kernel writes all lanes, so the sparse results are written afterwards.
+            for (size_t idx = interval.first; idx < interval.second; ++idx)
+            {
+                size_t const seqIdx = idx % simd_len;
+                if (sparseLane[seqIdx])
+                {
+                    bound.currentUpper[seqIdx] = solvers[idx].lagrange.sparseRelaxedAlignment(sparseTrace[seqIdx],
+                                                                                             params.rnaScore);
+                    ++sparseAlignments;
+                }
+            }
 
             durationThreadAlign += Clock::now() - timeCurrent;
 
@@ -278,40 +423,36 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
                 SubgradientSolver & ss = solvers[idx];
 
                 timeCurrent = Clock::now();
+                if (sparseLane[seqIdx])
+                    std::swap(trace, sparseTrace[seqIdx]);
+                else if (singlePair)
+                    wavefront.traceback(trace);
+                else
+                    kernel.traceback(trace, seqIdx);
                 bound.currentLower[seqIdx] = ss.lagrange.valid_solution(ss.subgradient, ss.subgradientIndices,
-                                                                  std::make_pair(alignments[aliIdx].first[seqIdx],
-                                                                                 alignments[aliIdx].second[seqIdx]),
-                                                                  params.matching,
-                                                                  params.rnaScore);
+                                                                        trace, params.matching,
+                                                                        params.rnaScore);
                 durationThreadMatching += Clock::now() - timeCurrent;
             }
 
             // compare upper bound
-            auto cmp = seqan::cmpGt(bound.bestUpper, bound.currentUpper);
-            bound.bestUpper = seqan::blend(bound.bestUpper, bound.currentUpper, cmp);
-            bound.nondecreasing = seqan::blend(bound.nondecreasing, zeros, cmp);
+            auto cmpUpper = seqan::cmpGt(bound.bestUpper, bound.currentUpper);
+            bound.bestUpper = seqan::blend(bound.bestUpper, bound.currentUpper, cmpUpper);
 
             // compare lower bound
-            cmp = seqan::cmpGt(bound.currentLower, bound.bestLower);
-            bound.bestLower = seqan::blend(bound.bestLower, bound.currentLower, cmp);
-            bound.nondecreasing = seqan::blend(bound.nondecreasing, zeros, cmp);
-
-            // if the limit of nondecreasing iteration is reached then use the half step size
-            bound.nondecreasing = bound.nondecreasing + ones;
-            auto mask = seqan::cmpGt(bound.nondecreasing, maxiter);
-            bound.stepFactor = seqan::blend(bound.stepFactor, bound.stepFactor / twos, mask);
-            bound.nondecreasing = seqan::blend(bound.nondecreasing, zeros, mask);
+            auto cmpLower = seqan::cmpGt(bound.currentLower, bound.bestLower);
+            bound.bestLower = seqan::blend(bound.bestLower, bound.currentLower, cmpLower);
 
             // decrement remaining iterations
             bound.remainingIterations -= ones;
 
-            // array for the new step size
-            std::array<ScoreType, simd_len> stepSizeArray{};
-            seqan::storeu(stepSizeArray.data(), bound.stepFactor * (bound.bestUpper - bound.bestLower));
+            // array for the lanes, in which one of the bounds has improved
+            std::array<ScoreType, simd_len> improved{};
+            seqan::storeu(improved.data(), cmpUpper | cmpLower);
 
-            // array for equal bounds
+            // array for equal bounds (up to epsilon)
             std::array<ScoreType, simd_len> equalBounds{};
-            seqan::storeu(equalBounds.data(), seqan::cmpEq(bound.bestUpper, bound.bestLower));
+            seqan::storeu(equalBounds.data(), seqan::cmpGt(gapLimit, bound.bestUpper - bound.bestLower));
 
             // array for remaining iterations
             std::array<UnsignedType, simd_len> remainingIter{};
@@ -324,13 +465,6 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
                     continue;
                 SubgradientSolver & ss = solvers[idx];
 
-                float stepSize = static_cast<float>(stepSizeArray[seqIdx]) / factor2int / ss.subgradientIndices.size();
-                for (size_t si : ss.subgradientIndices)
-                {
-                    ss.dual[si] -= stepSize * ss.subgradient[si];
-                    ss.subgradient[si] = 0.0f;
-                }
-
                 SEQAN_ASSERT_MSG(!ss.subgradientIndices.empty() || bound.currentUpper[seqIdx] == bound.currentLower[seqIdx],
                                  (std::string{"The bounds differ, although there are no subgradients. "} +
                                      "Problem in aligning sequences " +
@@ -342,60 +476,79 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
                                          seqan::toCString(store[ss.sequenceIndices.first].name) + " and " +
                                          seqan::toCString(store[ss.sequenceIndices.second].name)).c_str());
 
+                ss.step.update(ss.dual, ss.subgradient, ss.subgradientIndices, bound.currentUpper[seqIdx],
+                               bound.bestUpper[seqIdx], bound.bestLower[seqIdx], improved[seqIdx] != 0);
+
+                // The bounds are equal up to epsilon, either absolute or relative to the upper bound.
+                bool const converged = equalBounds[seqIdx] ||
+                                       relativeGapClosed(bound.bestLower[seqIdx], bound.bestUpper[seqIdx],
+                                                         params.relativeGap);
+
+                // The best solution has not changed for a while and the bounds are close.
+                bool const stable = params.stableRounds > 0u &&
+                                    ss.lagrange.getStableRounds() >= params.stableRounds &&
+                                    relativeGapClosed(bound.bestLower[seqIdx], bound.bestUpper[seqIdx], params.stableGap);
+
                 // The alignment is finished.
-                if (equalBounds[seqIdx] || remainingIter[seqIdx] == 0)
+                if (converged || stable || expired || remainingIter[seqIdx] == 0)
                 {
-                    PosPair currentSeqIdx{};
+                    // Try to close the remaining gap with a branch and bound.
+                    if (params.bnbNodes > 0u && !converged && !stable && !expired)
+                        ss.lagrange.branchAndBound(bound.bestUpper[seqIdx], params.bnbNodes, epsilon, ss.subgradient,
+                                                   ss.subgradientIndices, params.matching, params.rnaScore);
+
                     #pragma omp critical (finished_alignment)
                     {
                         // write results
                         results.addAlignment(ss.lagrange.getStructureLines(params, ss.sequenceIndices));
                         _LOG(2, "     Thread " << aliIdx << "." << seqIdx << " finished alignment "
                                 << ss.sequenceIndices.first << "/" << ss.sequenceIndices.second << std::endl);
-
-                        if (iter == inputPairs.cend())
-                        {
-                            at_work[seqIdx] = false;
-                            --num_at_work;
-                        }
-                        else
-                        {
-                            currentSeqIdx = *iter;
-                            ++iter;
-                        }
                     } // end critical region
 
-                    if (at_work[seqIdx])
+                    if (params.warmStart && converged)
+                        ss.lagrange.recordDuals(ss.dual, dualStore, ss.sequenceIndices);
+
+                    // Reset scores.
+                    ss.lagrange.unbind();
+
+                    if (expired || !pipeline.next(solvers[idx]))
                     {
-                        // Reset scores.
-                        scores[aliIdx].reset(seqIdx);
+                        at_work[seqIdx] = false;
+                        --num_at_work;
+                    }
+                    else
+                    {
+                        PosPair const & currentSeqIdx = solvers[idx].sequenceIndices;
 
-                        // Set new sequences.
-                        seq1[idx] = PrefixType(integerSeq, length(store[currentSeqIdx.first].sequence));
-                        seq2[idx] = PrefixType(integerSeq, length(store[currentSeqIdx.second].sequence));
-                        alignments[aliIdx].first[seqIdx] = GappedSeq(seq1[idx]);
-                        alignments[aliIdx].second[seqIdx] = GappedSeq(seq2[idx]);
+                        // Set new sequence lengths.
+                        lengths[idx] = std::make_pair(length(store[currentSeqIdx.first].sequence),
+                                                      length(store[currentSeqIdx.second].sequence));
 
                         // Set new score matrix.
-                        solvers[idx] = SubgradientSolver(currentSeqIdx, store, params, &(scores[aliIdx]), seqIdx);
-                        scores[aliIdx].updateLongestSeq(seq1, seq2, interval);
-                        bound.bestLower[seqIdx] = -infinity;
+                        solvers[idx].lagrange.bind(&(scores[aliIdx]), seqIdx);
+                        bound.bestLower[seqIdx] = solvers[idx].initialLower;
                         bound.bestUpper[seqIdx] = infinity;
                         bound.currentLower[seqIdx] = -infinity;
                         bound.currentUpper[seqIdx] = infinity;
-                        bound.nondecreasing[seqIdx] = 0u;
-                        bound.stepFactor[seqIdx] = stepFactor;
-                        bound.remainingIterations[seqIdx] = params.numIterations;
+                        bound.remainingIterations[seqIdx] = budget.iterationCap(params.numIterations);
                     }
                 }
                 else
                 {
                     timeCurrent = Clock::now();
                     ss.lagrange.updateScores(ss.dual, ss.subgradientIndices, params.rnaScore);
+                    ++ss.iterations;
+
+                    // Remove the alignment edges that cannot be part of a better solution.
+                    if (params.pruneInterval > 0u && ss.iterations % params.pruneInterval == 0u)
+                        ss.lagrange.pruneEdges(bound.bestLower[seqIdx], params.rnaScore);
                     durationThreadUpdate += Clock::now() - timeCurrent;
                 }
             }
+            budget.addRound(Clock::now() - timeRound);
         }
+        --workingThreads;
+        ++idleThreads;
 
         #pragma omp critical (update_time)
         {
@@ -403,8 +556,30 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
             durationMatching += durationThreadMatching;
             durationUpdate += durationThreadUpdate;
             durationSerial += Clock::now() - timeThreadSerial;
+            numSparse += sparseAlignments;
+            numBanded += bandedAlignments;
+            numFull += fullAlignments;
+            numWavefront += wavefrontAlignments;
         }
     } // end parallel for
+#ifdef WITH_OPENMP
+    omp_set_max_active_levels(previousLevels);
+#endif
+
+    // The pairs, which have not been started before the time limit, are aligned by their sequences only.
+    std::vector<PosPair> const cancelledPairs = pipeline.cancel();
+    #pragma omp parallel for num_threads(params.threads) schedule(dynamic)
+    for (size_t idx = 0ul; idx < cancelledPairs.size(); ++idx)
+    {
+        PosPair const & pair = cancelledPairs[idx];
+        WeightedAlignedColumns lines = sequenceAlignmentLines(store[pair.first].sequence, store[pair.second].sequence,
+                                                              params, pair);
+        #pragma omp critical (finished_alignment)
+        {
+            results.addAlignment(lines);
+            _LOG(2, "     Time limit: sequence alignment for " << pair.first << "/" << pair.second << std::endl);
+        }
+    }
 
     auto durationToSeconds = [] (Clock::duration duration)
         { return std::chrono::duration_cast<std::chrono::seconds>(duration).count(); };
@@ -413,7 +588,9 @@ void solve(lara::OutputLibrary & results, InputStorage const & store, Parameters
             << "     (serial: " << durationToSeconds(durationSerial)
             << "s, ali: " << durationToSeconds(durationAlign)
             << "s, match: " << durationToSeconds(durationMatching)
-            << "s, update: " << durationToSeconds(durationUpdate) << "s)" << std::endl);
+            << "s, update: " << durationToSeconds(durationUpdate) << "s)" << std::endl
+            << "     (DP runs: " << numSparse << " sparse, " << numBanded << " banded, " << numFull << " full, "
+            << numWavefront << " wavefront for a single pair)" << std::endl);
 }
 
 } // namespace lara
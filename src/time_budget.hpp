@@ -0,0 +1,129 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+
+#pragma once
+
+/*!\file time_budget.hpp
+ * \brief This file contains the time limit for solving the structural alignments.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include "data_types.hpp"
+
+namespace lara
+{
+
+/*!
+ * \brief Distributes a wall-clock time limit over the pairs of sequences that are still to be aligned.
+ * \details
+ * The budget measures the average duration of an iteration round, in which every thread advances each of its
+ * pairs by one iteration. When a pair is started, it gets as many iterations as fit into its share of the remaining
+ * time, but at most the configured number. A time limit of 0 means that there is no limit.
+ */
+class TimeBudget
+{
+private:
+    Clock::time_point const start;
+    Clock::duration const limit;
+    size_t const parallel;
+    std::atomic<size_t> remainingPairs;
+    std::atomic<int64_t> roundDuration;
+    std::atomic<uint64_t> rounds;
+
+public:
+    /*!
+     * \brief Set up the budget.
+     * \param timeStart The point in time, from which the limit is measured.
+     * \param seconds The time limit in seconds, or 0 for no limit.
+     * \param numPairs The number of pairs to be aligned.
+     * \param numParallel The number of pairs that are aligned at the same time.
+     */
+    TimeBudget(Clock::time_point timeStart, unsigned seconds, size_t numPairs, size_t numParallel) :
+        start{timeStart},
+        limit{std::chrono::seconds(seconds)},
+        parallel{std::max<size_t>(numParallel, 1ul)},
+        remainingPairs{numPairs},
+        roundDuration{0},
+        rounds{0u}
+    {}
+
+    TimeBudget()                               = delete;
+    TimeBudget(TimeBudget const &)             = delete;
+    TimeBudget(TimeBudget &&)                  = delete;
+    TimeBudget & operator=(TimeBudget const &) = delete;
+    TimeBudget & operator=(TimeBudget &&)      = delete;
+
+    //!\brief Whether the time limit is reached.
+    bool expired() const
+    {
+        return limit != Clock::duration::zero() && Clock::now() - start >= limit;
+    }
+
+    //!\brief Add the measured duration of an iteration round.
+    void addRound(Clock::duration duration)
+    {
+        roundDuration += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        ++rounds;
+    }
+
+    /*!
+     * \brief Start a new pair and compute its number of iterations.
+     * \param maxIterations The configured number of iterations.
+     * \return The number of iterations that fit into the time share of the pair, between 1 and maxIterations.
+     */
+    unsigned iterationCap(unsigned maxIterations)
+    {
+        size_t const pairs = remainingPairs.fetch_sub(1ul); // including this pair
+        uint64_t const numRounds = rounds.load();
+        if (limit == Clock::duration::zero() || numRounds == 0u)
+            return maxIterations;
+
+        auto const remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(limit - (Clock::now() - start));
+        if (remaining.count() <= 0)
+            return 1u;
+
+        // The remaining pairs are aligned in batches of the parallel lanes.
+        double const batches = std::ceil(static_cast<double>(pairs) / parallel);
+        double const roundTime = static_cast<double>(roundDuration.load()) / numRounds;
+        double const cap = remaining.count() / batches / roundTime;
+        return static_cast<unsigned>(std::max(1.0, std::min(cap, static_cast<double>(maxIterations))));
+    }
+};
+
+} // namespace lara
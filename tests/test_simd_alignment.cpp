@@ -0,0 +1,223 @@
+// ===========================================================================
+//                LaRA: Lagrangian Relaxed structural Alignment
+// ===========================================================================
+// Copyright (c) 2016-2019, Jörg Winkler, Freie Universität Berlin
+// Copyright (c) 2016-2019, Gianvito Urgese, Politecnico di Torino
+// Copyright (c) 2006-2019, Knut Reinert, Freie Universität Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// * Neither the name of Jörg Winkler, Gianvito Urgese, Knut Reinert,
+//   the FU Berlin or the Politecnico di Torino nor the names of
+//   its contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+
+/*!\file test_simd_alignment.cpp
+ * \brief Tests for the SIMD alignment kernels against the scalar Gotoh DP.
+ */
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+#include <seqan/basic.h>
+
+#include "../src/data_types.hpp"
+#include "../src/edge_filter.hpp"
+#include "../src/score.hpp"
+
+#ifdef SEQAN_SIMD_ENABLED
+#include "../src/simd_alignment.hpp"
+
+namespace
+{
+
+typedef typename seqan::SimdVector<lara::ScoreType>::Type TVector;
+enum : size_t { numLanes = seqan::LENGTH<TVector>::VALUE };
+
+// Fill the lanes with random lengths and random scores in random row ranges. Some lanes stay unused.
+void randomLanes(lara::RnaScoreType & score, std::array<lara::PosPair, numLanes> & lengths, std::mt19937 & rng,
+                 lara::ScoreType go, lara::ScoreType ge)
+{
+    size_t const rows = rng() % 40u + 1u;
+    score.init(rows, 0ul, go, ge);
+    lengths.fill(lara::PosPair{0ul, 0ul});
+    for (size_t lane = 0ul; lane < numLanes; ++lane)
+    {
+        if (rng() % 6u == 0u)
+            continue;
+
+        lengths[lane] = {rng() % rows + 1u, rng() % 45u + 1u};
+        std::vector<lara::RnaScoreType::TRange> ranges(lengths[lane].first);
+        for (lara::RnaScoreType::TRange & range : ranges)
+        {
+            range.first = rng() % lengths[lane].second;
+            range.second = range.first + rng() % (lengths[lane].second - range.first + 1u);
+        }
+        score.bind(lane, ranges);
+        for (size_t row = 0ul; row < ranges.size(); ++row)
+            for (size_t col = ranges[row].first; col < ranges[row].second; ++col)
+                if (rng() % 2u == 0u)
+                    score.set(lane, row, col, static_cast<lara::ScoreType>(rng() % 20000u) - 5000);
+    }
+}
+
+// The scalar Gotoh DP of a lane.
+lara::PairwiseGotoh laneGotoh(lara::RnaScoreType const & score, lara::PosPair const & length, size_t lane,
+                              lara::ScoreType go, lara::ScoreType ge)
+{
+    return lara::PairwiseGotoh(length.first, length.second,
+                               [&score, lane] (size_t posA, size_t posB)
+                               {
+                                   return static_cast<lara::ScoreType>(score.matrix.value(posA, posB)[lane]);
+                               },
+                               go, ge);
+}
+
+void assertEqualTraces(lara::TraceSegments const & expected, lara::TraceSegments const & actual)
+{
+    SEQAN_ASSERT_EQ(seqan::length(expected), seqan::length(actual));
+    for (size_t idx = 0ul; idx < seqan::length(expected); ++idx)
+    {
+        SEQAN_ASSERT_EQ(expected[idx]._horizontalBeginPos, actual[idx]._horizontalBeginPos);
+        SEQAN_ASSERT_EQ(expected[idx]._verticalBeginPos, actual[idx]._verticalBeginPos);
+        SEQAN_ASSERT_EQ(expected[idx]._length, actual[idx]._length);
+        SEQAN_ASSERT_EQ(expected[idx]._traceValue, actual[idx]._traceValue);
+    }
+}
+
+} // namespace
+#endif
+
+// The full SIMD DP computes the same scores and traces as the scalar DP in each lane.
+SEQAN_DEFINE_TEST(test_simd_gotoh_full)
+{
+#ifdef SEQAN_SIMD_ENABLED
+    std::mt19937 rng(5u);
+    lara::SimdGotoh<TVector> kernel;
+    lara::RnaScoreType score;
+    std::array<lara::PosPair, numLanes> lengths;
+    lara::TraceSegments expected;
+    lara::TraceSegments actual;
+    for (unsigned round = 0u; round < 500u; ++round)
+    {
+        lara::ScoreType const go = -static_cast<lara::ScoreType>(rng() % 3000u + 500u);
+        lara::ScoreType const ge = -static_cast<lara::ScoreType>(rng() % 500u + 1u);
+        randomLanes(score, lengths, rng, go, ge);
+
+        TVector result;
+        kernel.align(result, score, lengths, go, ge);
+        for (size_t lane = 0ul; lane < numLanes; ++lane)
+        {
+            if (lengths[lane].first == 0ul)
+                continue;
+
+            lara::PairwiseGotoh gotoh = laneGotoh(score, lengths[lane], lane, go, ge);
+            SEQAN_ASSERT_EQ(gotoh.getOptimalScore(), result[lane]);
+            gotoh.traceback(expected);
+            kernel.traceback(actual, lane);
+            assertEqualTraces(expected, actual);
+        }
+    }
+#else
+    SEQAN_SKIP_TEST;
+#endif
+}
+
+// The banded SIMD DP matches the full DP, if the band contains the optimal alignments of all lanes, and it never
+// exceeds the full DP otherwise.
+SEQAN_DEFINE_TEST(test_simd_gotoh_banded)
+{
+#ifdef SEQAN_SIMD_ENABLED
+    typedef seqan::TraceBitMap_<> TraceBitMap;
+    std::mt19937 rng(7u);
+    lara::SimdGotoh<TVector> kernel;
+    lara::RnaScoreType score;
+    std::array<lara::PosPair, numLanes> lengths;
+    lara::TraceSegments expected;
+    lara::TraceSegments actual;
+    for (unsigned round = 0u; round < 500u; ++round)
+    {
+        lara::ScoreType const go = -static_cast<lara::ScoreType>(rng() % 3000u + 500u);
+        lara::ScoreType const ge = -static_cast<lara::ScoreType>(rng() % 500u + 1u);
+        randomLanes(score, lengths, rng, go, ge);
+
+        TVector full;
+        kernel.align(full, score, lengths, go, ge);
+
+        // the diagonals of the optimal alignments and of the last cells
+        int lowerDiag = 0;
+        int upperDiag = 0;
+        int cornerLower = 0;
+        int cornerUpper = 0;
+        for (size_t lane = 0ul; lane < numLanes; ++lane)
+        {
+            if (lengths[lane].first == 0ul)
+                continue;
+
+            int const corner = static_cast<int>(lengths[lane].first) - static_cast<int>(lengths[lane].second);
+            cornerLower = std::min(cornerLower, corner);
+            cornerUpper = std::max(cornerUpper, corner);
+            laneGotoh(score, lengths[lane], lane, go, ge).traceback(expected);
+            for (size_t idx = 0ul; idx < seqan::length(expected); ++idx)
+            {
+                int const diag = static_cast<int>(expected[idx]._horizontalBeginPos) -
+                                 static_cast<int>(expected[idx]._verticalBeginPos);
+                int const step = expected[idx]._traceValue == TraceBitMap::HORIZONTAL ? 1 :
+                                 (expected[idx]._traceValue == TraceBitMap::VERTICAL ? -1 : 0);
+                lowerDiag = std::min({lowerDiag, diag, diag + step});
+                upperDiag = std::max({upperDiag, diag, diag + step});
+            }
+        }
+
+        TVector banded;
+        kernel.align(banded, score, lengths, go, ge, lowerDiag - static_cast<int>(rng() % 3u),
+                     upperDiag + static_cast<int>(rng() % 3u));
+        for (size_t lane = 0ul; lane < numLanes; ++lane)
+        {
+            if (lengths[lane].first == 0ul)
+                continue;
+
+            SEQAN_ASSERT_EQ(full[lane], banded[lane]);
+            laneGotoh(score, lengths[lane], lane, go, ge).traceback(expected);
+            kernel.traceback(actual, lane);
+            assertEqualTraces(expected, actual);
+        }
+
+        TVector narrow;
+        kernel.align(narrow, score, lengths, go, ge, cornerLower, cornerUpper);
+        for (size_t lane = 0ul; lane < numLanes; ++lane)
+            if (lengths[lane].first != 0ul)
+                SEQAN_ASSERT_LEQ(narrow[lane], full[lane]);
+    }
+#else
+    SEQAN_SKIP_TEST;
+#endif
+}
+
+SEQAN_BEGIN_TESTSUITE(test_simd_alignment)
+{
+    SEQAN_CALL_TEST(test_simd_gotoh_full);
+    SEQAN_CALL_TEST(test_simd_gotoh_banded);
+}
+SEQAN_END_TESTSUITE